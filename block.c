@@ -0,0 +1,941 @@
+#include "block.h"
+
+static int32_t block_read_full(int fildes, uint8_t *dst, uint64_t size) {
+  while (size) {
+    ssize_t readed = READ(dst, sizeof(*dst), size, fildes);
+    if (!readed) {
+      eprintf("Unexpected end of archive\n");
+      return -1;
+    }
+    dst += readed;
+    size -= readed;
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+buffer_t* block_reserve(buffer_t *buff, uint64_t size) {
+  if (size > BUFF_MAX_SIZE) {
+    eprintf("Block is too big\n");
+    if (buff) {
+      buffer_destroy(buff);
+    }
+    return NULL;
+  }
+  if (buff && buff->buffer_capacity >= size) {
+    return buff;
+  }
+  if (buff) {
+    buffer_destroy(buff);
+  }
+  return buffer_init_memory(size);
+}
+
+static uint32_t block_index_hash(const uint8_t *data, uint64_t size) {
+  uint32_t hash = 2166136261U;
+  uint64_t i;
+  for (i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 16777619U;
+  }
+  return hash;
+}
+
+static int32_t block_index_add(block_index *index, uint64_t block_bytes,
+                               uint64_t raw_size) {
+  if (index->count == index->capacity) {
+    uint32_t capacity = index->capacity ? index->capacity * 2 : 64;
+    block_index_entry *grown = realloc(index->entries,
+                                       capacity * sizeof(*grown));
+    if (!grown) {
+      ERROR_GOTO();
+    }
+    index->entries = grown;
+    index->capacity = capacity;
+  }
+  index->entries[index->count].offset = index->offset;
+  index->entries[index->count].raw_offset = index->raw_size;
+  index->count++;
+  index->offset += block_bytes;
+  index->raw_size += raw_size;
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+#define BLOCK_PUT_LE64(bytes, value)                                           \
+      ({                                                                       \
+        uint64_t tmp_value = htole64(value);                                   \
+        memcpy(bytes, &tmp_value, sizeof(tmp_value));                          \
+      })
+
+#define BLOCK_PUT_LE32(bytes, value)                                           \
+      ({                                                                       \
+        uint32_t tmp_value = htole32(value);                                   \
+        memcpy(bytes, &tmp_value, sizeof(tmp_value));                          \
+      })
+
+#define BLOCK_GET_LE64(bytes)                                                  \
+      ({                                                                       \
+        uint64_t tmp_value;                                                    \
+        memcpy(&tmp_value, bytes, sizeof(tmp_value));                          \
+        le64toh(tmp_value);                                                    \
+      })
+
+#define BLOCK_GET_LE32(bytes)                                                  \
+      ({                                                                       \
+        uint32_t tmp_value;                                                    \
+        memcpy(&tmp_value, bytes, sizeof(tmp_value));                          \
+        le32toh(tmp_value);                                                    \
+      })
+
+/*
+ * Write index block of blocks written since last index and start new one.
+ */
+static int32_t block_index_write(block_index *index, int fildes) {
+  uint64_t entries_size = (uint64_t)index->count * BLOCK_INDEX_ENTRY_SIZE;
+  uint64_t payload_size = entries_size + BLOCK_INDEX_TRAILER_SIZE;
+  block_header header = { BLOCK_INDEX, 0, 0, payload_size };
+  uint8_t *payload = NULL;
+  uint8_t *trailer;
+  uint32_t i;
+
+  payload = MALLOC(payload_size);
+  trailer = &payload[entries_size];
+  for (i = 0; i < index->count; i++) {
+    BLOCK_PUT_LE64(&payload[i * BLOCK_INDEX_ENTRY_SIZE],
+                   index->entries[i].offset);
+    BLOCK_PUT_LE64(&payload[i * BLOCK_INDEX_ENTRY_SIZE + 8],
+                   index->entries[i].raw_offset);
+  }
+  BLOCK_PUT_LE64(&trailer[0], index->prev);
+  BLOCK_PUT_LE64(&trailer[8], index->raw_size);
+  BLOCK_PUT_LE32(&trailer[16], index->count);
+  BLOCK_PUT_LE32(&trailer[20], block_index_hash(payload, entries_size + 20));
+  BLOCK_PUT_LE64(&trailer[24], index->offset);
+  BLOCK_PUT_LE64(&trailer[32], BLOCK_INDEX_MAGIC);
+
+  BLOCK_HEADER_WRITE(header, fildes);
+  WRITE(payload, sizeof(*payload), payload_size, fildes);
+  FREE(payload);
+
+  index->prev = index->offset;
+  index->offset += BLOCK_HEADER_SIZE + payload_size;
+  index->count = 0;
+  return 0;
+_err:
+  ERROR_MSG();
+  FREE(payload);
+  ERROR_RETURN(-1);
+}
+
+static int32_t block_read_at(int fildes, uint64_t offset, uint8_t *dst,
+                             uint64_t size) {
+  if (lseek(fildes, offset, SEEK_SET) < 0) {
+    ERROR_GOTO();
+  }
+  return block_read_full(fildes, dst, size);
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Check index block that ends at end of file, read only its payload.
+ */
+static bool block_index_trailer_valid(int fildes, uint64_t size,
+                                      block_index *index) {
+  uint8_t trailer[BLOCK_INDEX_TRAILER_SIZE];
+  uint8_t header_bytes[BLOCK_HEADER_SIZE];
+  block_header header;
+  uint8_t *payload = NULL;
+  bool valid = false;
+
+  if (size < sizeof(uint64_t) + BLOCK_HEADER_SIZE + BLOCK_INDEX_TRAILER_SIZE ||
+      block_read_at(fildes, size - sizeof(trailer), trailer, sizeof(trailer)) < 0 ||
+      BLOCK_GET_LE64(&trailer[32]) != BLOCK_INDEX_MAGIC) {
+    return false;
+  }
+  uint64_t offset = BLOCK_GET_LE64(&trailer[24]);
+  uint64_t payload_size = (uint64_t)BLOCK_GET_LE32(&trailer[16]) *
+                          BLOCK_INDEX_ENTRY_SIZE + BLOCK_INDEX_TRAILER_SIZE;
+  if (offset < sizeof(uint64_t) ||
+      offset + BLOCK_HEADER_SIZE + payload_size != size ||
+      block_read_at(fildes, offset, header_bytes, sizeof(header_bytes)) < 0) {
+    return false;
+  }
+  BLOCK_HEADER_PARSE(header, header_bytes);
+  if (header.type != BLOCK_INDEX || header.payload_size != payload_size) {
+    return false;
+  }
+  payload = malloc(payload_size);
+  if (payload &&
+      block_read_full(fildes, payload, payload_size) == 0 &&
+      block_index_hash(payload, payload_size - 20) ==
+      BLOCK_GET_LE32(&payload[payload_size - 20])) {
+    index->offset = size;
+    index->prev = offset;
+    index->raw_size = BLOCK_GET_LE64(&trailer[8]);
+    valid = true;
+  }
+  free(payload);
+  return valid;
+}
+
+int32_t block_index_find(int fildes, block_index *index) {
+  uint8_t header_bytes[BLOCK_HEADER_SIZE];
+  block_header header;
+  uint64_t position = sizeof(uint64_t);
+  uint64_t raw_size = 0;
+  off_t size = lseek(fildes, 0, SEEK_END);
+
+  if (size < (off_t)sizeof(uint64_t)) {
+    eprintf("Not a block archive\n");
+    ERROR_GOTO();
+  }
+  if (block_index_trailer_valid(fildes, size, index)) {
+    return 0;
+  }
+
+  index->offset = position;
+  index->raw_size = 0;
+  index->prev = 0;
+  while (position + BLOCK_HEADER_SIZE <= (uint64_t)size) {
+    if (lseek(fildes, position, SEEK_SET) < 0) {
+      ERROR_GOTO();
+    }
+    if (READ(header_bytes, sizeof(*header_bytes), BLOCK_HEADER_SIZE, fildes) !=
+        BLOCK_HEADER_SIZE) {
+      break;
+    }
+    BLOCK_HEADER_PARSE(header, header_bytes);
+    if ((header.flags & ~BLOCK_FLAGS_KNOWN) || header.type > BLOCK_TYPE_LAST ||
+        position + BLOCK_HEADER_SIZE + header.payload_size > (uint64_t)size) {
+      break;
+    }
+    if (header.type == BLOCK_INDEX) {
+      index->prev = position;
+    }
+    position += BLOCK_HEADER_SIZE + header.payload_size;
+    raw_size += header.raw_size;
+    if (header.type == BLOCK_INDEX || !index->prev) {
+      index->offset = position;
+      index->raw_size = raw_size;
+    }
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Position file after committed part of archive for append. New archive
+ * is started if file is empty.
+ */
+static int32_t block_append_start(int fildes, block_index *index) {
+  uint64_t magic;
+  off_t size = lseek(fildes, 0, SEEK_END);
+
+  if (size < 0) {
+    ERROR_GOTO();
+  }
+  if (!size) {
+    magic = htole64(BLOCK_MAGIC);
+    WRITE(&magic, sizeof(magic), 1, fildes);
+    index->offset = sizeof(magic);
+    return 0;
+  }
+  if (block_read_at(fildes, 0, (uint8_t *)&magic, sizeof(magic)) < 0 ||
+      le64toh(magic) != BLOCK_MAGIC) {
+    eprintf("Not a block archive\n");
+    ERROR_GOTO();
+  }
+  if (block_index_find(fildes, index) < 0) {
+    ERROR_GOTO();
+  }
+  if (index->offset < (uint64_t)size) {
+    eprintf("Dropping %llu bytes of interrupted append\n",
+            (unsigned long long)(size - index->offset));
+    if (ftruncate(fildes, index->offset) < 0) {
+      ERROR_GOTO();
+    }
+  }
+  if (lseek(fildes, index->offset, SEEK_SET) < 0) {
+    ERROR_GOTO();
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int64_t block_encode_huffman(huff_node *tree, huff_code *hnc[],
+                                    const uint8_t *data, uint64_t size,
+                                    buffer_t *payload) {
+  BUFFER_RESET(payload);
+
+  write_tree(tree, payload, hnc);
+  if (huff_codes_append(hnc, NULL, data, size, payload) < 0) {
+    ERROR_GOTO();
+  }
+  return BUFFER_FINISH(payload);
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Find symbols of block, return their count up to 3.
+ */
+static uint32_t block_symbols(const uint64_t hist[], uint8_t symbols[2]) {
+  uint32_t count = 0;
+  uint32_t s;
+  for (s = 0; s < MAX_SYMBOLS && count < 3; s++) {
+    if (hist[s]) {
+      if (count < 2) {
+        symbols[count] = s;
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+static uint64_t block_encode_bitmap(const uint8_t *data, uint64_t size,
+                                    const uint8_t symbols[2],
+                                    uint8_t *payload) {
+  uint8_t *bitmap = &payload[BLOCK_BITMAP_HEADER_SIZE];
+  uint64_t i;
+  uint32_t j;
+
+  payload[0] = symbols[0];
+  payload[1] = symbols[1];
+  for (i = 0; i < size / CHAR_BIT; i++) {
+    const uint8_t *bytes = &data[i * CHAR_BIT];
+    uint8_t bits = 0;
+    for (j = 0; j < CHAR_BIT; j++) {
+      bits = bits << 1 | (bytes[j] == symbols[1]);
+    }
+    bitmap[i] = bits;
+  }
+  if (size % CHAR_BIT) {
+    uint8_t bits = 0;
+    for (j = 0; j < size % CHAR_BIT; j++) {
+      bits |= (data[i * CHAR_BIT + j] == symbols[1]) << (CHAR_BIT - 1 - j);
+    }
+    bitmap[i++] = bits;
+  }
+  return BLOCK_BITMAP_HEADER_SIZE + i;
+}
+
+/*
+ * Estimate size of block from entropy of its histogram, table and header.
+ */
+static double block_cost_bits(const uint64_t hist[], uint64_t size) {
+  double bits = BLOCK_HEADER_SIZE * CHAR_BIT;
+  double coded = 0;
+  uint32_t s;
+  for (s = 0; s < MAX_SYMBOLS; s++) {
+    if (hist[s]) {
+      coded += hist[s] * log2((double)size / hist[s]) + BLOCK_SYMBOL_COST_BITS;
+    }
+  }
+  return bits + (coded < size * CHAR_BIT ? coded : size * CHAR_BIT);
+}
+
+/*
+ * Choose smallest coding of data and fill type and payload size of header.
+ * Header must be set to raw block before call.
+ */
+static int32_t block_encode_coded(const uint8_t *data, uint64_t size,
+                                  const uint64_t hist[], block_encoder *be,
+                                  block_header *header,
+                                  const uint8_t **payload_data) {
+  uint16_t norm[MAX_SYMBOLS];
+  huff_node *hnt[MAX_SYMBOLS] = {NULL};
+  huff_code *hnc[MAX_SYMBOLS] = {NULL};
+  buffer_t *payload = be->payload;
+  int32_t symbols_count = 0;
+  int64_t payload_size;
+  uint8_t symbols[2];
+
+  uint32_t distinct = block_symbols(hist, symbols);
+  if (distinct == 1) {
+    header->type = BLOCK_RLE;
+    header->payload_size = 1;
+    payload->buffer[0] = symbols[0];
+    *payload_data = payload->buffer;
+    return 0;
+  }
+
+  if (huff_nodes_init_histogram(hnt, hist) < 0) {
+    ERROR_GOTO();
+  }
+  symbols_count = construct_tree(hnt);
+
+  uint64_t raw_bits = size * CHAR_BIT;
+  uint64_t huff_bits = huff_tree_cost(hnt[0], 0) + huff_tree_size(hnt[0]);
+  uint64_t fse_bits = UINT64_MAX;
+  if (symbols_count > 1) {
+    fse_normalize(hist, size, norm);
+    fse_bits = fse_estimate_bits(hist, norm);
+  }
+  uint64_t wide_bits = be->hw ? huff_wide_build(be->hw, data, size) : UINT64_MAX;
+  /* Codes of two symbols are one bit each, bitmap decodes faster. */
+  uint64_t bitmap_bits = distinct == 2 ?
+          (BLOCK_BITMAP_HEADER_SIZE + (size + CHAR_BIT - 1) / CHAR_BIT) *
+          CHAR_BIT : UINT64_MAX;
+
+  if (bitmap_bits < raw_bits && bitmap_bits < wide_bits &&
+      bitmap_bits <= fse_bits) {
+    header->type = BLOCK_BITMAP;
+    header->payload_size = block_encode_bitmap(data, size, symbols,
+                                               payload->buffer);
+    *payload_data = payload->buffer;
+  } else if (wide_bits < raw_bits && wide_bits < huff_bits &&
+             wide_bits < fse_bits) {
+    header->type = BLOCK_HUFFMAN16;
+    header->payload_size = huff_wide_encode(be->hw, data, size, payload);
+    *payload_data = payload->buffer;
+  } else if (huff_bits < raw_bits && huff_bits <= fse_bits) {
+    payload_size = block_encode_huffman(hnt[0], hnc, data, size, payload);
+    if (payload_size < 0) {
+      ERROR_GOTO();
+    }
+    header->type = BLOCK_HUFFMAN;
+    header->payload_size = payload_size;
+    *payload_data = payload->buffer;
+  } else if (fse_bits < raw_bits) {
+    payload_size = fse_encode(data, size, norm, payload->buffer, size);
+    if (payload_size >= 0) {
+      header->type = BLOCK_FSE;
+      header->payload_size = payload_size;
+      *payload_data = payload->buffer;
+    }
+  }
+
+  huff_nodes_destroy(hnt, symbols_count);
+  huff_codes_destroy(hnc);
+  return 0;
+_err:
+  ERROR_MSG();
+  huff_nodes_destroy(hnt, symbols_count);
+  huff_codes_destroy(hnc);
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Transform costs throughput, it is used only if it saves enough.
+ */
+static bool block_transform_gains(const uint64_t transform_hist[],
+                                  uint64_t transform_size,
+                                  const uint64_t hist[], uint64_t size) {
+  double bits = block_cost_bits(hist, size);
+  return block_cost_bits(transform_hist, transform_size) <
+         bits - bits / BLOCK_TRANSFORM_MIN_GAIN;
+}
+
+/*
+ * Check that transform makes block smaller on few evenly spaced parts, so
+ * blocks where it does not help are not transformed whole. Transform grows
+ * data at most by quarter, scratch has room for twice of part.
+ */
+static bool block_transform_worth(const uint8_t *data, uint64_t size,
+                                  uint8_t *scratch) {
+  uint64_t hist[MAX_SYMBOLS] = {0};
+  uint64_t transform_hist[MAX_SYMBOLS] = {0};
+  uint64_t step = size / BLOCK_SAMPLE_PARTS;
+  uint64_t transform_size = 0;
+  uint32_t i;
+
+  if (step <= BLOCK_SAMPLE_PART_SIZE) {
+    return true;
+  }
+  for (i = 0; i < BLOCK_SAMPLE_PARTS; i++) {
+    const uint8_t *part = &data[i * step];
+    int64_t part_size = mtf_rle_encode(part, BLOCK_SAMPLE_PART_SIZE, scratch,
+                                       2 * BLOCK_SAMPLE_PART_SIZE);
+    count_symbol_frequency(hist, part, BLOCK_SAMPLE_PART_SIZE);
+    count_symbol_frequency(transform_hist, scratch, part_size);
+    transform_size += part_size;
+  }
+  return block_transform_gains(transform_hist, transform_size, hist,
+                               BLOCK_SAMPLE_PARTS * BLOCK_SAMPLE_PART_SIZE);
+}
+
+/*
+ * Code one block. With transform memory data is also move-to-front and
+ * zero run transformed, transformed data is coded if its entropy estimate
+ * is smaller and some coder compresses it.
+ */
+static int32_t block_encode_one(const uint8_t *data, uint64_t size,
+                                const uint64_t block_hist[], block_encoder *be,
+                                int fildes) {
+  uint64_t hist[MAX_SYMBOLS] = {0};
+  uint64_t transform_hist[MAX_SYMBOLS] = {0};
+  block_header header = { BLOCK_RAW, 0, size, size };
+  const uint8_t *payload_data = data;
+  const uint8_t *coded = data;
+  const uint64_t *coded_hist = hist;
+  uint64_t coded_size = size;
+
+  if (block_hist) {
+    memcpy(hist, block_hist, sizeof(hist));
+  } else {
+    count_symbol_frequency(hist, data, size);
+  }
+
+  if (be->transform &&
+      block_transform_worth(data, size, be->transform->buffer)) {
+    int64_t transform_size = mtf_rle_encode(data, size, be->transform->buffer,
+                                            size);
+    if (transform_size > 0) {
+      count_symbol_frequency(transform_hist, be->transform->buffer,
+                             transform_size);
+      if (block_transform_gains(transform_hist, transform_size, hist, size)) {
+        coded = be->transform->buffer;
+        coded_hist = transform_hist;
+        coded_size = transform_size;
+        header.flags = BLOCK_FLAG_MTF_RLE;
+      }
+    }
+  }
+
+  if (block_encode_coded(coded, coded_size, coded_hist, be,
+                         &header, &payload_data) < 0) {
+    ERROR_GOTO();
+  }
+
+  if (header.flags && header.type == BLOCK_RAW) {
+    header.flags = 0;
+    header.payload_size = size;
+    payload_data = data;
+  }
+  if (header.flags) {
+    uint32_t transform_size = htole32(coded_size);
+    header.payload_size += BLOCK_TRANSFORM_HEADER_SIZE;
+    BLOCK_HEADER_WRITE(header, fildes);
+    WRITE(&transform_size, sizeof(transform_size), 1, fildes);
+    WRITE(payload_data, sizeof(*payload_data),
+          header.payload_size - BLOCK_TRANSFORM_HEADER_SIZE, fildes);
+  } else {
+    BLOCK_HEADER_WRITE(header, fildes);
+    WRITE(payload_data, sizeof(*payload_data), header.payload_size, fildes);
+  }
+  if (block_index_add(&be->index, BLOCK_HEADER_SIZE + header.payload_size,
+                      size) < 0) {
+    ERROR_GOTO();
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Greedy left to right splitting. Each segment is merged to current block
+ * if merged block is estimated not bigger than two separate blocks.
+ */
+static int32_t block_encode_split(const uint8_t *data, uint64_t size,
+                                  block_encoder *be, int fildes) {
+  uint64_t block_hist[MAX_SYMBOLS];
+  uint64_t segment_hist[MAX_SYMBOLS];
+  uint64_t merged_hist[MAX_SYMBOLS];
+  uint64_t start = 0;
+  uint64_t end = 0;
+  uint32_t s;
+
+  while (end < size) {
+    uint64_t segment = size - end < BLOCK_SEGMENT_SIZE ? size - end : BLOCK_SEGMENT_SIZE;
+    memset(segment_hist, 0, sizeof(segment_hist));
+    count_symbol_frequency(segment_hist, &data[end], segment);
+
+    if (end == start) {
+      memcpy(block_hist, segment_hist, sizeof(block_hist));
+    } else {
+      for (s = 0; s < MAX_SYMBOLS; s++) {
+        merged_hist[s] = block_hist[s] + segment_hist[s];
+      }
+      double split_bits = block_cost_bits(block_hist, end - start) +
+                          block_cost_bits(segment_hist, segment);
+      double merged_bits = block_cost_bits(merged_hist, end - start + segment);
+      if (merged_bits > split_bits) {
+        if (block_encode_one(&data[start], end - start, block_hist,
+                             be, fildes) < 0) {
+          ERROR_GOTO();
+        }
+        start = end;
+        memcpy(block_hist, segment_hist, sizeof(block_hist));
+      } else {
+        memcpy(block_hist, merged_hist, sizeof(block_hist));
+      }
+    }
+    end += segment;
+  }
+  return block_encode_one(&data[start], end - start, block_hist, be, fildes);
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int32_t block_decode_huffman(buffer_t *payload, uint8_t *out,
+                                    uint64_t size) {
+  huff_node *tree = NULL;
+  huff_table *table = NULL;
+
+  payload->buffer_position = 0;
+  payload->bit_position = CHAR_BIT;
+  if (read_tree(&tree, payload) < 0) {
+    ERROR_GOTO();
+  }
+
+  table = huff_table_init(tree, huff_table_choose_symbols(tree));
+  if (!table) {
+    ERROR_GOTO();
+  }
+  BUFFER_BITS_INIT(payload);
+  if (huff_table_decode(table, payload, out, size) < 0) {
+    ERROR_GOTO();
+  }
+
+  huff_table_destroy(table);
+  huff_tree_destroy(tree);
+  return 0;
+_err:
+  ERROR_MSG();
+  huff_table_destroy(table);
+  huff_tree_destroy(tree);
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Expand bitmap eight bytes per step. Byte of bitmap is copied to every
+ * byte of word, each byte keeps its own bit and adding 0x7f moves that
+ * bit to top of byte without carry to next byte.
+ */
+static int32_t block_decode_bitmap(const block_header *header,
+                                   const uint8_t *payload, uint8_t *out) {
+  const uint8_t *bitmap = &payload[BLOCK_BITMAP_HEADER_SIZE];
+  uint64_t size = header->raw_size;
+  uint64_t fill = 0x0101010101010101ULL * payload[0];
+  uint64_t diff = payload[0] ^ payload[1];
+  uint64_t i;
+  uint32_t j;
+
+  if (header->payload_size !=
+      BLOCK_BITMAP_HEADER_SIZE + (size + CHAR_BIT - 1) / CHAR_BIT) {
+    eprintf("Corrupted block header\n");
+    ERROR_GOTO();
+  }
+  for (i = 0; i < size / CHAR_BIT; i++) {
+    uint64_t bits = (bitmap[i] * 0x0101010101010101ULL) &
+                    0x0102040810204080ULL;
+    bits = ((bits + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL;
+    uint64_t word = htole64(fill ^ bits * diff);
+    memcpy(&out[i * CHAR_BIT], &word, sizeof(word));
+  }
+  for (j = 0; j < size % CHAR_BIT; j++) {
+    out[i * CHAR_BIT + j] = payload[bitmap[i] >> (CHAR_BIT - 1 - j) & 1];
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+void block_decoder_clear(block_decoder *bd) {
+  bd->hw = huff_wide_destroy(bd->hw);
+  if (bd->transform) {
+    buffer_destroy(bd->transform);
+    bd->transform = NULL;
+  }
+}
+
+/*
+ * Decode coded transformed data to bd->transform, then restore raw bytes.
+ */
+static int32_t block_decode_transformed(const block_header *header,
+                                        buffer_t *payload, uint8_t *out,
+                                        block_decoder *bd) {
+  block_header inner = { header->type, 0, 0, 0 };
+  uint32_t transform_size;
+
+  if (header->payload_size < BLOCK_TRANSFORM_HEADER_SIZE ||
+      header->type == BLOCK_RAW) {
+    eprintf("Corrupted block header\n");
+    ERROR_GOTO();
+  }
+  memcpy(&transform_size, payload->buffer, sizeof(transform_size));
+  inner.raw_size = le32toh(transform_size);
+  inner.payload_size = header->payload_size - BLOCK_TRANSFORM_HEADER_SIZE;
+  memmove(payload->buffer, &payload->buffer[BLOCK_TRANSFORM_HEADER_SIZE],
+          inner.payload_size);
+  payload->buffer_size = inner.payload_size;
+
+  bd->transform = block_reserve(bd->transform, inner.raw_size);
+  if (!bd->transform) {
+    ERROR_GOTO();
+  }
+  if (block_decode_one(&inner, payload, bd->transform->buffer, bd) < 0) {
+    ERROR_GOTO();
+  }
+  if (mtf_rle_decode(bd->transform->buffer, inner.raw_size,
+                     out, header->raw_size) != header->raw_size) {
+    eprintf("Corrupted transformed block\n");
+    ERROR_GOTO();
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+int32_t block_decode_one(const block_header *header, buffer_t *payload,
+                         uint8_t *out, block_decoder *bd) {
+  if (header->flags & ~BLOCK_FLAGS_KNOWN) {
+    eprintf("Corrupted block header\n");
+    ERROR_GOTO();
+  }
+  if (header->flags & BLOCK_FLAG_MTF_RLE) {
+    return block_decode_transformed(header, payload, out, bd);
+  }
+
+  switch (header->type) {
+    case BLOCK_RAW:
+      if (header->raw_size != header->payload_size) {
+        eprintf("Corrupted block header\n");
+        ERROR_GOTO();
+      }
+      if (out != payload->buffer) {
+        memcpy(out, payload->buffer, header->raw_size);
+      }
+      break;
+    case BLOCK_HUFFMAN:
+      if (block_decode_huffman(payload, out, header->raw_size) < 0) {
+        ERROR_GOTO();
+      }
+      break;
+    case BLOCK_FSE:
+      if (fse_decode(payload->buffer, header->payload_size,
+                     out, header->raw_size) < 0) {
+        ERROR_GOTO();
+      }
+      break;
+    case BLOCK_HUFFMAN16:
+      if (!bd->hw && !(bd->hw = huff_wide_init())) {
+        ERROR_GOTO();
+      }
+      if (huff_wide_decode(bd->hw, payload, out, header->raw_size) < 0) {
+        ERROR_GOTO();
+      }
+      break;
+    case BLOCK_INDEX:
+      if (header->raw_size) {
+        eprintf("Corrupted block header\n");
+        ERROR_GOTO();
+      }
+      break;
+    case BLOCK_RLE:
+      if (header->payload_size != 1) {
+        eprintf("Corrupted block header\n");
+        ERROR_GOTO();
+      }
+      memset(out, payload->buffer[0], header->raw_size);
+      break;
+    case BLOCK_BITMAP:
+      if (block_decode_bitmap(header, payload->buffer, out) < 0) {
+        ERROR_GOTO();
+      }
+      break;
+    default:
+      eprintf("Unknown block type %u\n", header->type);
+      ERROR_GOTO();
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static void block_encoder_clear(block_encoder *be) {
+  if (be->payload) {
+    buffer_destroy(be->payload);
+  }
+  if (be->transform) {
+    buffer_destroy(be->transform);
+  }
+  huff_wide_destroy(be->hw);
+  FREE(be->index.entries);
+}
+
+int32_t block_encode(buffer_t *buff_in, buffer_t *buff_out, uint32_t flags,
+                     progress_t *progress) {
+  uint64_t magic = htole64(BLOCK_MAGIC);
+  block_encoder be = { NULL, NULL, NULL, { NULL, 0, 0, sizeof(magic), 0, 0 } };
+  int32_t ret;
+
+  be.payload = buffer_init_memory(buff_in->buffer_capacity);
+  if (!be.payload) {
+    ERROR_GOTO();
+  }
+  if ((flags & BLOCK_ENCODE_WIDE) && !(be.hw = huff_wide_init())) {
+    ERROR_GOTO();
+  }
+  if ((flags & BLOCK_ENCODE_MTF) &&
+      !(be.transform = buffer_init_memory(buff_in->buffer_capacity))) {
+    ERROR_GOTO();
+  }
+
+  if (flags & BLOCK_ENCODE_APPEND) {
+    if (block_append_start(buff_out->file, &be.index) < 0) {
+      ERROR_GOTO();
+    }
+  } else {
+    WRITE(&magic, sizeof(magic), 1, buff_out->file);
+  }
+
+  while (BUFFER_READ(buff_in) != NULL) {
+    if (flags & BLOCK_ENCODE_SPLIT) {
+      ret = block_encode_split(buff_in->buffer, buff_in->buffer_size,
+                               &be, buff_out->file);
+    } else {
+      ret = block_encode_one(buff_in->buffer, buff_in->buffer_size, NULL,
+                             &be, buff_out->file);
+    }
+    if (ret < 0) {
+      ERROR_GOTO();
+    }
+    PROGRESS_UPDATE(progress, buff_in->buffer_size);
+  }
+
+  if ((flags & BLOCK_ENCODE_APPEND) && fdatasync(buff_out->file) < 0) {
+    ERROR_GOTO();
+  }
+  if (block_index_write(&be.index, buff_out->file) < 0) {
+    ERROR_GOTO();
+  }
+  if ((flags & BLOCK_ENCODE_APPEND) && fdatasync(buff_out->file) < 0) {
+    ERROR_GOTO();
+  }
+
+  block_encoder_clear(&be);
+  return 0;
+_err:
+  ERROR_MSG();
+  block_encoder_clear(&be);
+  ERROR_RETURN(-1);
+}
+
+int32_t block_decode(buffer_t *buff_in, buffer_t *buff_out, bool map_output,
+                     progress_t *progress) {
+  block_header header;
+  buffer_t *payload = buffer_init_memory(BLOCK_DEFAULT_SIZE);
+  buffer_t *raw = buffer_init_memory(BLOCK_DEFAULT_SIZE);
+  block_decoder bd = { NULL, NULL };
+  block_index index = { NULL, 0, 0, 0, 0, 0 };
+  off_t start = lseek(buff_in->file, 0, SEEK_CUR);
+  uint64_t position = start < 0 ? 0 : start;
+  uint64_t end = UINT64_MAX;
+  uint8_t *map = NULL;
+  uint64_t raw_position = 0;
+  ssize_t header_size;
+  uint8_t *out;
+
+  if (!payload || !raw) {
+    ERROR_GOTO();
+  }
+
+  if (start >= 0) {
+    off_t size = lseek(buff_in->file, 0, SEEK_END);
+    if (block_index_find(buff_in->file, &index) < 0) {
+      ERROR_GOTO();
+    }
+    if (index.prev) {
+      end = index.offset;
+      if (end < (uint64_t)size) {
+        eprintf("Ignoring %llu bytes of interrupted append\n",
+                (unsigned long long)(size - end));
+      }
+    }
+    if (lseek(buff_in->file, start, SEEK_SET) < 0) {
+      ERROR_GOTO();
+    }
+    /* Raw size is known only from committed index. */
+    if (map_output && index.prev) {
+      map = buffer_map(buff_out, index.raw_size);
+    }
+  }
+
+  while (position < end &&
+         (header_size = BLOCK_HEADER_READ(header, buff_in->file)) != 0) {
+    if (header_size != BLOCK_HEADER_SIZE || (header.flags & ~BLOCK_FLAGS_KNOWN)) {
+      eprintf("Corrupted block header\n");
+      ERROR_GOTO();
+    }
+    if (map && header.raw_size > index.raw_size - raw_position) {
+      eprintf("Corrupted block archive\n");
+      ERROR_GOTO();
+    }
+    bool raw_block = header.type == BLOCK_RAW && !header.flags &&
+                     header.raw_size == header.payload_size;
+    if (map && raw_block) {
+      /* Stored block is read straight to its place. */
+      if (block_read_full(buff_in->file, &map[raw_position],
+                          header.payload_size) < 0) {
+        ERROR_GOTO();
+      }
+    } else {
+      payload = block_reserve(payload, header.payload_size);
+      raw = block_reserve(raw, map ? 0 : header.raw_size);
+      if (!payload || !raw) {
+        ERROR_GOTO();
+      }
+      if (block_read_full(buff_in->file, payload->buffer, header.payload_size) < 0) {
+        ERROR_GOTO();
+      }
+      payload->buffer_size = header.payload_size;
+
+      out = map ? &map[raw_position] : raw_block ? payload->buffer : raw->buffer;
+      if (block_decode_one(&header, payload, out, &bd) < 0) {
+        ERROR_GOTO();
+      }
+      if (!map) {
+        WRITE(out, sizeof(*out), header.raw_size, buff_out->file);
+      }
+    }
+    PROGRESS_UPDATE(progress, header.raw_size);
+    position += BLOCK_HEADER_SIZE + header.payload_size;
+    raw_position += header.raw_size;
+  }
+  if (map) {
+    if (raw_position != index.raw_size) {
+      eprintf("Corrupted block archive\n");
+      ERROR_GOTO();
+    }
+    if (buffer_unmap(buff_out, map, index.raw_size) < 0) {
+      map = NULL;
+      ERROR_GOTO();
+    }
+  }
+
+  buffer_destroy(payload);
+  buffer_destroy(raw);
+  block_decoder_clear(&bd);
+  return 0;
+_err:
+  ERROR_MSG();
+  if (map) {
+    munmap(map, index.raw_size);
+  }
+  if (payload) {
+    buffer_destroy(payload);
+  }
+  if (raw) {
+    buffer_destroy(raw);
+  }
+  block_decoder_clear(&bd);
+  ERROR_RETURN(-1);
+}
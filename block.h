@@ -0,0 +1,267 @@
+/**
+ * @file       block.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for block archive encoding and decoding.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef BLOCK_H_
+#define BLOCK_H_
+
+#include <stdint.h>
+#include <endian.h>
+#include <math.h>
+#include "error_handler.h"
+#include "huff_nodes.h"
+#include "huff_table.h"
+#include "fse.h"
+#include "huff_wide.h"
+#include "mtf.h"
+#include "buffer.h"
+#include "progress.h"
+
+
+#define BLOCK_MAGIC 0x0a1a0a0d42464889ULL   /// "\x89HFB\r\n\x1a\n" as LE
+#define BLOCK_INDEX_MAGIC 0x0a1a0a0d49464889ULL /// "\x89HFI\r\n\x1a\n" as LE
+#define BLOCK_DEFAULT_SIZE (1024*1024)      /// Size of block if not set
+#define BLOCK_HEADER_SIZE 10                /// Type, flags, sizes
+#define BLOCK_SPLIT_DEFAULT_SIZE (8*1024*1024) /// Largest adaptive block
+#define BLOCK_SEGMENT_SIZE (16*1024)        /// Step of adaptive splitting
+#define BLOCK_SYMBOL_COST_BITS 12           /// Estimated table bits per symbol
+
+#define BLOCK_ENCODE_WIDE 0x1               /// Also try 16 bit symbols
+#define BLOCK_ENCODE_SPLIT 0x2              /// Choose block boundaries
+#define BLOCK_ENCODE_MTF 0x4                /// Try MTF and zero run transform
+#define BLOCK_ENCODE_APPEND 0x8             /// Add blocks to existing archive
+
+#define BLOCK_FLAG_MTF_RLE 0x1              /// Payload is of transformed data
+#define BLOCK_FLAGS_KNOWN BLOCK_FLAG_MTF_RLE /// Flags this version decodes
+#define BLOCK_TRANSFORM_HEADER_SIZE 4       /// Size of transformed data
+#define BLOCK_TRANSFORM_MIN_GAIN 8         /// Transform must save 1/8 of size
+#define BLOCK_SAMPLE_PARTS 4                /// Parts of transform sample
+#define BLOCK_SAMPLE_PART_SIZE (4*1024)     /// Size of one sample part
+
+#define BLOCK_BITMAP_HEADER_SIZE 2          /// Two symbols before bitmap
+
+#define BLOCK_INDEX_ENTRY_SIZE 16           /// Block offset and raw offset
+#define BLOCK_INDEX_TRAILER_SIZE 40         /// Fields after index entries
+
+typedef enum {
+  BLOCK_RAW = 0,                    /**< Stored without coding */
+  BLOCK_HUFFMAN = 1,                /**< Huffman tree and codes */
+  BLOCK_FSE = 2,                    /**< FSE counts and bitstream */
+  BLOCK_HUFFMAN16 = 3,              /**< Canonical codes of 16 bit symbols */
+  BLOCK_INDEX = 4,                  /**< Offsets of blocks, no raw data */
+  BLOCK_RLE = 5,                    /**< One symbol repeated raw size times */
+  BLOCK_BITMAP = 6,                 /**< Two symbols and bit of each byte */
+} block_type_t;
+
+#define BLOCK_TYPE_LAST BLOCK_BITMAP        /// Largest known type
+
+/*
+ * Payload of RLE block is its only symbol. Payload of bitmap block is two
+ * symbols followed by one bit per byte, most significant bit first, set
+ * bit selects second symbol.
+ */
+
+/*
+ * Index block ends every archive and every append. Payload, little endian:
+ *   count entries of block offset u64 and raw offset u64
+ *   previous index offset u64, 0 is none
+ *   raw size of archive u64
+ *   count u32, FNV-1a of payload before it u32
+ *   offset of this index block u64, BLOCK_INDEX_MAGIC u64
+ * The last 40 bytes of archive are trailer of its last index. Append is
+ * committed when its index is written, data after last valid index is
+ * left from interrupted append.
+ */
+
+ /**
+  * @struct block_header
+  * @brief This struct store header of one block
+  */
+typedef struct block_header {
+  uint8_t  type;                    /**< Coder of block, block_type_t */
+  uint8_t  flags;                   /**< BLOCK_FLAG_* */
+  uint32_t raw_size;                /**< Size of decoded block */
+  uint32_t payload_size;            /**< Size of encoded block */
+} block_header;
+
+ /**
+  * @struct block_index_entry
+  * @brief This struct store position of one block
+  */
+typedef struct block_index_entry {
+  uint64_t offset;                  /**< Archive offset of block header */
+  uint64_t raw_offset;              /**< Offset of block in decoded data */
+} block_index_entry;
+
+ /**
+  * @struct block_index
+  * @brief This struct store blocks written since last index block
+  */
+typedef struct block_index {
+  block_index_entry *entries;       /**< Written blocks */
+  uint32_t count;                   /**< Count of entries */
+  uint32_t capacity;                /**< Allocated entries */
+  uint64_t offset;                  /**< Archive offset of next block */
+  uint64_t raw_size;                /**< Raw bytes in archive */
+  uint64_t prev;                    /**< Offset of last index block, 0 is none */
+} block_index;
+
+ /**
+  * @struct block_encoder
+  * @brief This struct store memory reused between encoded blocks
+  */
+typedef struct block_encoder {
+  buffer_t *payload;                /**< Coded block */
+  huff_wide *hw;                    /**< Coder for 16 bit blocks or NULL */
+  buffer_t *transform;              /**< Transformed block or NULL */
+  block_index index;                /**< Written blocks */
+} block_encoder;
+
+ /**
+  * @struct block_decoder
+  * @brief This struct store memory reused between decoded blocks
+  */
+typedef struct block_decoder {
+  huff_wide *hw;                    /**< Coder for 16 bit blocks or NULL */
+  buffer_t *transform;              /**< Transformed data or NULL */
+} block_decoder;
+
+/**
+ * Macros to write block header to file as little endian.
+ */
+#define BLOCK_HEADER_WRITE(header, fildes)                                     \
+      ({                                                                       \
+        uint8_t tmp_header[BLOCK_HEADER_SIZE];                                 \
+        uint32_t tmp_raw = htole32((header).raw_size);                         \
+        uint32_t tmp_payload = htole32((header).payload_size);                 \
+        tmp_header[0] = (header).type;                                         \
+        tmp_header[1] = (header).flags;                                        \
+        memcpy(&tmp_header[2], &tmp_raw, sizeof(tmp_raw));                     \
+        memcpy(&tmp_header[6], &tmp_payload, sizeof(tmp_payload));             \
+        WRITE(tmp_header, sizeof(*tmp_header), BLOCK_HEADER_SIZE, fildes);     \
+      })
+
+/**
+ * Macros to parse block header from little endian bytes.
+ */
+#define BLOCK_HEADER_PARSE(header, bytes)                                      \
+      ({                                                                       \
+        (header).type = (bytes)[0];                                            \
+        (header).flags = (bytes)[1];                                           \
+        memcpy(&(header).raw_size, &(bytes)[2], sizeof((header).raw_size));    \
+        memcpy(&(header).payload_size, &(bytes)[6],                            \
+               sizeof((header).payload_size));                                 \
+        (header).raw_size = le32toh((header).raw_size);                        \
+        (header).payload_size = le32toh((header).payload_size);                \
+      })
+
+/**
+ * Macros to read block header from file.
+ * Return count of read bytes, 0 on end of archive.
+ */
+#define BLOCK_HEADER_READ(header, fildes)                                      \
+      ({                                                                       \
+        uint8_t tmp_header[BLOCK_HEADER_SIZE];                                 \
+        ssize_t tmp_size = READ(tmp_header, sizeof(*tmp_header),               \
+                                BLOCK_HEADER_SIZE, fildes);                    \
+        BLOCK_HEADER_PARSE(header, tmp_header);                                \
+        tmp_size;                                                              \
+      })
+
+/**
+ * @brief Get memory buffer that can hold size bytes
+ * @details Buffer is kept if it is big enough, else it is freed and new
+ * buffer is created.
+ *
+ * @param buff Memory buffer or NULL
+ * @param size Needed size in bytes
+ * @return Buffer or NULL if failed or size is too big
+ */
+buffer_t* block_reserve(buffer_t *buff, uint64_t size);
+
+/**
+ * @brief Find committed end of block archive
+ * @details Trailer at end of file is checked first. If it is not valid
+ * block headers are scanned from start, end is after last index block or
+ * after last whole block if archive has no index. File position is
+ * changed.
+ *
+ * @param fildes Seekable archive file
+ * @param index Gets end offset, raw size and offset of last index block
+ * @return 0 on success and -1 if faild
+ */
+int32_t block_index_find(int fildes, block_index *index);
+
+/**
+ * @brief Free memory of block decoder
+ *
+ * @param bd Decoder, its members are set to NULL
+ */
+void block_decoder_clear(block_decoder *bd);
+
+/**
+ * @brief Decode payload of one block
+ * @details Raw payload is copied unless out is payload memory. Payload of
+ * transformed block starts with 32 bit size of transformed data, it is
+ * decoded to bd->transform and then inverse transform writes to out.
+ * Payload memory is changed in this case.
+ *
+ * @param header Header of block
+ * @param payload Memory buffer with whole payload
+ * @param out Memory for raw_size decoded bytes
+ * @param bd Reused memory, members are created on first use
+ * @return 0 on success and -1 if faild
+ */
+int32_t block_decode_one(const block_header *header, buffer_t *payload,
+                         uint8_t *out, block_decoder *bd);
+
+/**
+ * @brief Encode input as block archive
+ * @details Write magic, then split input by size of input buffer. For each
+ * block count symbols, estimate size with huffman, FSE and without coding
+ * and write block with smallest size. Block of one symbol is written as
+ * RLE block, block of two symbols as bitmap unless FSE is smaller. In wide
+ * mode block is also coded as 16 bit little endian symbols. In split mode
+ * size of input buffer is largest block, it is cut to blocks at
+ * BLOCK_SEGMENT_SIZE steps where separate blocks are estimated smaller
+ * than one merged block. With MTF option each block is also move-to-front
+ * and zero run transformed, the transformed data is coded if its estimate
+ * is smaller. Index block is written last. In append mode output must be
+ * opened for read and write, blocks are added after committed end of
+ * existing archive or new archive is started in empty file. Data is synced
+ * before and after index, so archive has old or new content after crash.
+ *
+ * @param buff_in Input buffer, its size is size of block
+ * @param buff_out Output buffer
+ * @param flags BLOCK_ENCODE_* options
+ * @param progress Progress reporter or NULL
+ * @return 0 on success and -1 if faild
+ */
+int32_t block_encode(buffer_t *buff_in, buffer_t *buff_out, uint32_t flags,
+                     progress_t *progress);
+
+/**
+ * @brief Decode block archive
+ * @details Magic must be already read from input file. Index blocks are
+ * skipped, so appended parts are decoded as one stream. If input is
+ * seekable and has index, data after last index is ignored.
+ * With map_output and index, blocks are decoded straight to mapped output
+ * file at their raw offsets.
+ *
+ * @param buff_in Input buffer
+ * @param buff_out Output buffer
+ * @param map_output Decode straight to mapped output file if it allows
+ * @param progress Progress reporter or NULL
+ * @return 0 on success and -1 if faild
+ */
+int32_t block_decode(buffer_t *buff_in, buffer_t *buff_out, bool map_output,
+                     progress_t *progress);
+
+#endif /* BLOCK_H_ */
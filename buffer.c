@@ -6,19 +6,107 @@ buffer_t* buffer_init(const char *file_path, buffer_mode_t buff_mode, uint64_t b
   switch (buff_mode) {
     case BUFFER_READ_MODE: mode = O_RDONLY; break;
     case BUFFER_WRITE_MODE: mode = O_CREAT| O_RDWR |O_TRUNC ; break;
+    case BUFFER_APPEND_MODE: mode = O_CREAT| O_RDWR ; break;
     default: eprintf("Wrong arg mode\n"); mode = O_RDWR ; break;
   }
-  buffer_t *buff = CALLOC(1, sizeof(*buff));
-  buff->buffer = CALLOC(buffer_size, sizeof(*buff->buffer));
+  buffer_t *buff = buffer_init_memory(buffer_size);
+  if (!buff) {
+    ERROR_GOTO();
+  }
   buff->file = OPEN(file_path, mode);
   return buff;
+_err:
+  ERROR_MSG();
+  if (buff) {
+    buffer_destroy(buff);
+  }
+  ERROR_RETURN(NULL);
+}
+
+
+uint64_t buffer_capacity_for(uint64_t buffer_size) {
+  if (buffer_size < BUFF_MIN_SIZE) {
+    buffer_size = BUFF_MIN_SIZE;
+  } else if (buffer_size > BUFF_MAX_SIZE) {
+    buffer_size = BUFF_MAX_SIZE;
+  }
+  return buffer_size - buffer_size % sizeof(uint64_t);
+}
+
+
+buffer_t* buffer_init_memory(uint64_t buffer_size) {
+  buffer_size = buffer_capacity_for(buffer_size);
+  buffer_t *buff = CALLOC(1, sizeof(*buff));
+  buff->buffer_capacity = buffer_size;
+  buff->buffer = CALLOC(buffer_size + BUFF_SLACK_SIZE, sizeof(*buff->buffer));
+  buff->file = -1;
+  return buff;
 _err:
   ERROR_MSG();
   ERROR_RETURN(NULL);
 }
 
 
+void buffer_attach(buffer_t *buff, int fildes) {
+  buff->buffer_position = 0;
+  buff->buffer_size = 0;
+  buff->bit_position = 0;
+  buff->bit_container = 0;
+  buff->bit_count = 0;
+  buff->buffer64[0] = 0;
+  buff->file = fildes;
+}
+
+
+uint8_t* buffer_map(buffer_t *buff, uint64_t size) {
+  struct stat st;
+  void *map;
+  int ret;
+
+  if (!size || (off_t)size < 0 || buff->file < 0 ||
+      fstat(buff->file, &st) < 0 || !S_ISREG(st.st_mode) ||
+      lseek(buff->file, 0, SEEK_CUR) != 0) {
+    return NULL;
+  }
+  if (ftruncate(buff->file, size) < 0) {
+    return NULL;
+  }
+  /* Store to hole of full disk would kill process with SIGBUS. */
+  ret = posix_fallocate(buff->file, 0, size);
+  if (ret && ret != EOPNOTSUPP && ret != EINVAL) {
+    errno = ret;
+    eprintf("Cannot reserve output file: %s\n", strerror(errno));
+    ERROR_GOTO();
+  }
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, buff->file, 0);
+  if (map == MAP_FAILED) {
+    ERROR_GOTO();
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+  return map;
+_err:
+  if (ftruncate(buff->file, st.st_size) < 0) {
+    ERROR_MSG();
+  }
+  return NULL;
+}
+
+
+int32_t buffer_unmap(buffer_t *buff, uint8_t *map, uint64_t size) {
+  if (munmap(map, size) < 0 || lseek(buff->file, size, SEEK_SET) < 0) {
+    ERROR_GOTO();
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+
 buffer_t* buffer_destroy(buffer_t *buff) {
+  if (buff->io) {
+    buffer_io_destroy(buff);
+  }
   CLOSE(buff->file);
   FREE(buff->buffer);
   FREE(buff);
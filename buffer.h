@@ -18,18 +18,23 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <endian.h>
 #include <fcntl.h>
 #include "error_handler.h"
 #include "macros.h"
 
-typedef enum { BUFFER_READ_MODE, BUFFER_WRITE_MODE } buffer_mode_t;
+typedef enum { BUFFER_READ_MODE, BUFFER_WRITE_MODE, BUFFER_APPEND_MODE } buffer_mode_t;
 
 
 #define UINT64_BIT (64)
 #define BUFF_MAX_SIZE (1024*1024*200)
+#define BUFF_MIN_SIZE (1024*64)         /// Smallest buffer, fits in L2 cache
+#define BUFF_LOW_MEM_SIZE (1024*1024)   /// Buffer size for low memory mode
+#define BUFF_SLACK_SIZE (2*sizeof(uint64_t)) /// Room for eof write chunks
 #define CHUNK_SIZE CHAR_BIT
 
+struct buffer_io;
 
  /**
   * @struct buffer_t
@@ -42,22 +47,86 @@ typedef struct buffer_t {
   };
   uint64_t buffer_position;         /**< Current chunk in buffer */
   uint64_t buffer_size;             /**< Count of chunks */
+  uint64_t buffer_capacity;         /**< Allocated size of buffer in bytes */
   uint32_t bit_position;            /**< Bit position in current chunk */
+  uint64_t bit_container;           /**< Prefetched bits for table decoding */
+  uint32_t bit_count;               /**< Count of valid bits in container */
   int      file;                    /**< File from wich buffer takes data */
+  struct buffer_io *io;             /**< Direct I/O backend or NULL */
 } buffer_t;
 
  /**
   * @brief Buffer initilization
   * @details Choose mode for buffer. If in read mode then file open with "r" flag else if
-  * in open file in "w+" mode. Allocates memory for this buffer
+  * in open file in "w+" mode. Allocates memory for this buffer. Buffer size is
+  * clamped to [BUFF_MIN_SIZE, BUFF_MAX_SIZE] and rounded down to write chunk.
   *
   * @param file_path Path to file which buffer will use.
   * @param buff_mode Mode wich choose type of buffer.
+  * @param buffer_size Size of buffer in bytes.
   *
   * @return Pointer to buffer or NULL if failed.
   */
 buffer_t* buffer_init(const char *file_path, buffer_mode_t buff_mode, uint64_t buffer_size);
 
+/**
+ * @brief Buffer initilization without file
+ * @details Buffer works only in memory. Reading after end of buffer gives
+ * empty buffer, writing must not overflow buffer.
+ *
+ * @param buffer_size Size of buffer in bytes.
+ *
+ * @return Pointer to buffer or NULL if failed.
+ */
+buffer_t* buffer_init_memory(uint64_t buffer_size);
+
+/**
+ * @brief Get capacity that buffer of buffer_size will have
+ *
+ * @param buffer_size Size of buffer in bytes.
+ *
+ * @return Size clamped to [BUFF_MIN_SIZE, BUFF_MAX_SIZE] and rounded down
+ * to write chunk.
+ */
+uint64_t buffer_capacity_for(uint64_t buffer_size);
+
+/**
+ * @brief Attach opened file to buffer
+ * @details Reset positions so buffer memory can be reused for next file.
+ * File is not closed by this call, previous file must be closed or
+ * detached with fildes -1 by caller.
+ *
+ * @param buff buffer_t
+ * @param fildes Opened file or -1 for memory buffer
+ */
+void buffer_attach(buffer_t *buff, int fildes);
+
+/**
+ * @brief Map output file of known size for writing
+ * @details File is truncated to size and its blocks are reserved, so
+ * decoder can store bytes straight to mapping at any offset, without
+ * staging them in buffer memory.
+ *
+ * @param buff buffer_t of output file at its start
+ * @param size Final size of file
+ *
+ * @return Mapping or NULL if file can not be mapped, then it is written
+ * as usual.
+ */
+uint8_t* buffer_map(buffer_t *buff, uint64_t size);
+
+/**
+ * @brief Unmap output file mapped by buffer_map
+ * @details Position of file is set to its end.
+ *
+ * @param buff buffer_t of output file
+ * @param map Mapping
+ * @param size Size of mapping
+ *
+ * @return 0 on success and -1 if failed
+ */
+int32_t buffer_unmap(buffer_t *buff, uint8_t *map, uint64_t size);
+
 /**
  * @brief Get nex block of file
  * @details Try to read next MAX_BUFF_SZIE bytes
@@ -78,12 +147,68 @@ uint64_t* buffer_get(buffer_t *buff);
  */
 buffer_t* buffer_destroy(buffer_t *buff);
 
+/**
+ * @brief Read next part of file with direct I/O backend
+ * @details Buffer memory is switched to slot that was read ahead and
+ * next part is requested into slot given before.
+ *
+ * @param buff buffer_t with backend
+ *
+ * @return Count of read bytes or -1 if failed
+ */
+int64_t buffer_io_read(buffer_t *buff);
+
+/**
+ * @brief Write size bytes of buffer with direct I/O backend
+ * @details Full buffer is written behind while buffer memory is switched
+ * to other slot. Partial buffer is written with plain call.
+ *
+ * @param buff buffer_t with backend
+ * @param size Count of bytes from buffer start
+ *
+ * @return size on success and -1 if failed
+ */
+int64_t buffer_io_write(buffer_t *buff, uint64_t size);
+
+/**
+ * @brief Wait for requests of direct I/O backend
+ * @details Drop O_DIRECT and set file position after data that caller
+ * read or wrote, so plain calls can follow.
+ *
+ * @param buff buffer_t with backend
+ *
+ * @return 0 on success and -1 if failed
+ */
+int32_t buffer_io_finish(buffer_t *buff);
+
+/**
+ * @brief Finish and free direct I/O backend
+ *
+ * @param buff buffer_t with backend
+ */
+void buffer_io_destroy(buffer_t *buff);
+
+/**
+ * Macros to check result of direct I/O backend.
+ */
+#define BUFFER_IO_CHECK(result)                                                \
+      ({                                                                       \
+        int64_t tmp_io_result = (result);                                      \
+        if (tmp_io_result < 0) {                                               \
+          ERROR_GOTO();                                                        \
+        }                                                                      \
+        tmp_io_result;                                                         \
+      })
+
 
 /**
  * Macros for rewind buffer file.
  */
 #define BUFFER_REWIND(buff)                                                    \
       ({                                                                       \
+        if (buff->io) {                                                        \
+          BUFFER_IO_CHECK(buffer_io_finish(buff));                             \
+        }                                                                      \
         lseek(buff->file, 0, SEEK_SET);                                        \
       })
 
@@ -94,8 +219,13 @@ buffer_t* buffer_destroy(buffer_t *buff);
  */
 #define BUFFER_WRITE(buff)                                                     \
       ({                                                                       \
-        WRITE(buff->buffer64, sizeof(*buff->buffer64),                         \
-              buff->buffer_position, buff->file);                              \
+        if (buff->io) {                                                        \
+          BUFFER_IO_CHECK(buffer_io_write(buff, buff->buffer_position *        \
+                                                sizeof(*buff->buffer64)));     \
+        } else {                                                               \
+          WRITE(buff->buffer64, sizeof(*buff->buffer64),                       \
+                buff->buffer_position, buff->file);                            \
+        }                                                                      \
         buff->buffer_position = 0;                                             \
         buff->bit_position = 0;                                                \
       })
@@ -107,14 +237,51 @@ buffer_t* buffer_destroy(buffer_t *buff);
  */
 #define BUFFER_WRITE_END(buff)                                                 \
       ({                                                                       \
+        if (buff->io) {                                                        \
+          BUFFER_IO_CHECK(buffer_io_finish(buff));                             \
+        }                                                                      \
         WRITE(buff->buffer64, sizeof(*buff->buffer64),                         \
               buff->buffer_position, buff->file);                              \
-        WRITE(&buff->buffer64[output_buff->buffer_position],                   \
+        if (buff->bit_position) {                                              \
+          buff->buffer64[buff->buffer_position] <<=                            \
+                                UINT64_BIT - buff->bit_position;               \
+          buff->buffer64[buff->buffer_position] =                              \
+                                htobe64(buff->buffer64[buff->buffer_position]);\
+        }                                                                      \
+        WRITE(&buff->buffer64[buff->buffer_position],                          \
           sizeof(*buff->buffer), (buff->bit_position / CHAR_BIT),              \
            buff->file);                                                        \
       })
 
 
+/**
+ * Macros to finish memory write buffer. Move bits of last chunk to its
+ * start and convert it to big endian.
+ * Return count of used bytes.
+ */
+#define BUFFER_FINISH(buff)                                                    \
+      ({                                                                       \
+        if (buff->bit_position) {                                              \
+          buff->buffer64[buff->buffer_position] <<=                            \
+                                UINT64_BIT - buff->bit_position;               \
+          buff->buffer64[buff->buffer_position] =                              \
+                                htobe64(buff->buffer64[buff->buffer_position]);\
+        }                                                                      \
+        buff->buffer_position * sizeof(*buff->buffer64) +                      \
+                             (buff->bit_position + CHAR_BIT - 1) / CHAR_BIT;   \
+      })
+
+/**
+ * Macros to start writing to memory buffer from begin.
+ */
+#define BUFFER_RESET(buff)                                                     \
+      ({                                                                       \
+        buff->buffer_position = 0;                                             \
+        buff->bit_position = 0;                                                \
+        buff->buffer64[0] = 0;                                                 \
+      })
+
+
 /**
  * Macros to read file to buffer as read chunks.
  * Set buffer position to 0 and buffer bit position to read chunk size
@@ -122,8 +289,10 @@ buffer_t* buffer_destroy(buffer_t *buff);
  */
 #define BUFFER_READ(buff)                                                      \
       ({                                                                       \
-        buff->buffer_size = READ(buff->buffer, sizeof(*buff->buffer),          \
-                                 BUFF_MAX_SIZE, buff->file);                   \
+        buff->buffer_size = buff->file < 0 ? 0 :                               \
+                            buff->io ? BUFFER_IO_CHECK(buffer_io_read(buff)) : \
+                            READ(buff->buffer, sizeof(*buff->buffer),          \
+                                 buff->buffer_capacity, buff->file);           \
         buff->buffer_position = 0;                                             \
         buff->bit_position = CHAR_BIT;                                         \
         buff->buffer_size == 0 ? NULL : buff->buffer;                          \
@@ -135,7 +304,8 @@ buffer_t* buffer_destroy(buffer_t *buff);
  */
 #define BUFFER_CHECK_W_OVERFLOW(buff)                                          \
       ({                                                                       \
-        if (buff->buffer_position == (BUFF_MAX_SIZE/8)) {                      \
+        if (buff->buffer_position ==                                           \
+            buff->buffer_capacity / sizeof(*buff->buffer64)) {                 \
           BUFFER_WRITE(buff);                                                  \
         }                                                                      \
       })
@@ -146,7 +316,7 @@ buffer_t* buffer_destroy(buffer_t *buff);
  */
 #define BUFFER_CHECK_R_OVERFLOW(buff)                                          \
       ({                                                                       \
-        if (buff->buffer_position == BUFF_MAX_SIZE) {                          \
+        if (buff->buffer_position == buff->buffer_size) {                      \
           BUFFER_READ(buff);                                                   \
         }                                                                      \
       })
@@ -321,4 +491,77 @@ buffer_t* buffer_destroy(buffer_t *buff);
         bit;                                                                   \
       })
 
+
+/* Buffer bit container operations */
+
+/**
+ * Macros to move rest of current read chunk to bit container.
+ * After that bits must be taken only with BUFFER_BITS_* macroses.
+ */
+#define BUFFER_BITS_INIT(buff)                                                 \
+      ({                                                                       \
+        buff->bit_container = buff->buffer[buff->buffer_position] &            \
+                              ((1U << buff->bit_position) - 1);                \
+        buff->bit_count = buff->bit_position;                                  \
+        BUFFER_NEXT_R_CHUNK(buff);                                             \
+      })
+
+/**
+ * Macros to fill bit container at least to 56 bits.
+ * Takes 8 bytes at once if they are in buffer, else byte by byte.
+ * After end of file container filled with zeros.
+ */
+#define BUFFER_BITS_REFILL(buff)                                               \
+      ({                                                                       \
+        if (buff->bit_count < UINT64_BIT - CHAR_BIT &&                         \
+            buff->buffer_position + sizeof(uint64_t) <= buff->buffer_size) {   \
+          uint64_t tmp_bits;                                                   \
+          uint32_t tmp_bytes = (UINT64_BIT - 1 - buff->bit_count) / CHAR_BIT;  \
+          memcpy(&tmp_bits, &buff->buffer[buff->buffer_position],              \
+                 sizeof(tmp_bits));                                            \
+          buff->bit_container = (buff->bit_container << tmp_bytes * CHAR_BIT) |\
+                    (be64toh(tmp_bits) >> (UINT64_BIT - tmp_bytes * CHAR_BIT));\
+          buff->bit_count += tmp_bytes * CHAR_BIT;                             \
+          buff->buffer_position += tmp_bytes;                                  \
+        }                                                                      \
+        while (buff->bit_count < UINT64_BIT - CHAR_BIT) {                      \
+          if (buff->buffer_position == buff->buffer_size &&                    \
+              buff->buffer_size) {                                             \
+            BUFFER_READ(buff);                                                 \
+          }                                                                    \
+          buff->bit_container <<= CHAR_BIT;                                    \
+          buff->bit_count += CHAR_BIT;                                         \
+          if (buff->buffer_position < buff->buffer_size) {                     \
+            buff->bit_container |= buff->buffer[buff->buffer_position++];      \
+          }                                                                    \
+        }                                                                      \
+      })
+
+/**
+ * Macros to get next numbits from bit container without moving.
+ */
+#define BUFFER_BITS_PEEK(buff, numbits)                                        \
+      ({                                                                       \
+        (buff->bit_container >> (buff->bit_count - (numbits))) &               \
+                                          ((1ULL << (numbits)) - 1);           \
+      })
+
+/**
+ * Macros to drop numbits from bit container.
+ */
+#define BUFFER_BITS_SKIP(buff, numbits)                                        \
+      ({                                                                       \
+        buff->bit_count -= (numbits);                                          \
+      })
+
+/**
+ * Macros to write first size bytes of buffer to file.
+ */
+#define BUFFER_WRITE_BYTES(buff, size)                                         \
+      ({                                                                       \
+        buff->io ? BUFFER_IO_CHECK(buffer_io_write(buff, size)) :              \
+                   WRITE(buff->buffer, sizeof(*buff->buffer), size,            \
+                         buff->file);                                          \
+      })
+
 #endif /* FILE_IO_ */
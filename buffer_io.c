@@ -0,0 +1,458 @@
+#include "buffer_io.h"
+
+#ifdef BUFFER_IO_URING
+
+#define BUFFER_IO_RING_PTR(map, offset) ((uint32_t *)((uint8_t *)(map) + (offset)))
+
+static void buffer_io_ring_destroy(buffer_io *io) {
+  if (io->sqes) {
+    munmap(io->sqes, io->sqes_size);
+  }
+  if (io->cq_map && io->cq_map != io->sq_map) {
+    munmap(io->cq_map, io->cq_map_size);
+  }
+  if (io->sq_map) {
+    munmap(io->sq_map, io->sq_map_size);
+  }
+  if (io->ring >= 0) {
+    close(io->ring);
+  }
+}
+
+static int32_t buffer_io_ring_init(buffer_io *io, uint32_t entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  io->ring = syscall(__NR_io_uring_setup, entries, &p);
+  if (io->ring < 0) {
+    return -1;
+  }
+  io->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  io->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(*io->cqes);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (io->cq_map_size > io->sq_map_size) {
+      io->sq_map_size = io->cq_map_size;
+    }
+    io->cq_map_size = io->sq_map_size;
+  }
+  io->sq_map = mmap(NULL, io->sq_map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_SQ_RING);
+  if (io->sq_map == MAP_FAILED) {
+    io->sq_map = NULL;
+    return -1;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    io->cq_map = io->sq_map;
+  } else {
+    io->cq_map = mmap(NULL, io->cq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_CQ_RING);
+    if (io->cq_map == MAP_FAILED) {
+      io->cq_map = NULL;
+      return -1;
+    }
+  }
+  io->sqes_size = p.sq_entries * sizeof(*io->sqes);
+  io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_SQES);
+  if (io->sqes == MAP_FAILED) {
+    io->sqes = NULL;
+    return -1;
+  }
+  io->sq_tail = BUFFER_IO_RING_PTR(io->sq_map, p.sq_off.tail);
+  io->sq_mask = BUFFER_IO_RING_PTR(io->sq_map, p.sq_off.ring_mask);
+  io->sq_array = BUFFER_IO_RING_PTR(io->sq_map, p.sq_off.array);
+  io->cq_head = BUFFER_IO_RING_PTR(io->cq_map, p.cq_off.head);
+  io->cq_tail = BUFFER_IO_RING_PTR(io->cq_map, p.cq_off.tail);
+  io->cq_mask = BUFFER_IO_RING_PTR(io->cq_map, p.cq_off.ring_mask);
+  io->cqes = (struct io_uring_cqe *)((uint8_t *)io->cq_map + p.cq_off.cqes);
+  return 0;
+}
+
+static int buffer_io_enter(buffer_io *io, uint32_t submit, uint32_t wait) {
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, io->ring, submit, wait,
+                  wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+  return ret;
+}
+
+/*
+ * Take all completions from ring and store results in their slots.
+ */
+static void buffer_io_reap(buffer_io *io) {
+  uint32_t head = *io->cq_head;
+  uint32_t tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+    buffer_io_slot *slot = &io->slots[cqe->user_data / BUFFER_IO_MAX_DEPTH];
+    slot->results[cqe->user_data % BUFFER_IO_MAX_DEPTH] = cqe->res;
+    slot->pending--;
+    head++;
+  }
+  __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * Queue one request per chunk of slot. Requests that ring does not take
+ * stay failed and are done with plain calls on completion.
+ */
+static void buffer_io_submit(buffer_io *io, uint32_t index) {
+  buffer_io_slot *slot = &io->slots[index];
+  uint32_t tail = *io->sq_tail;
+  uint32_t count = 0;
+  uint64_t done;
+
+  for (done = 0; done < slot->size; done += io->chunk_size, count++) {
+    uint64_t len = slot->size - done < io->chunk_size ?
+                   slot->size - done : io->chunk_size;
+    uint32_t sq_index = (tail + count) & *io->sq_mask;
+    struct io_uring_sqe *sqe = &io->sqes[sq_index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = slot->write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = io->file;
+    sqe->addr = (uintptr_t)&slot->memory[done];
+    sqe->len = len;
+    sqe->off = slot->offset + done;
+    sqe->user_data = index * BUFFER_IO_MAX_DEPTH + count;
+    io->sq_array[sq_index] = sq_index;
+    slot->results[count] = -EAGAIN;
+  }
+  __atomic_store_n(io->sq_tail, tail + count, __ATOMIC_RELEASE);
+  slot->active = true;
+  slot->pending = count;
+  int submitted = buffer_io_enter(io, count, 0);
+  if (submitted < 0) {
+    submitted = 0;
+  }
+  /* Entries that were not consumed are dropped from ring. */
+  if ((uint32_t)submitted < count) {
+    __atomic_store_n(io->sq_tail, tail + submitted, __ATOMIC_RELEASE);
+    slot->pending = submitted;
+  }
+}
+
+static int32_t buffer_io_wait(buffer_io *io, buffer_io_slot *slot) {
+  buffer_io_reap(io);
+  while (slot->pending) {
+    if (buffer_io_enter(io, 0, 1) < 0) {
+      eprintf("Cannot wait for io_uring\n");
+      ERROR_GOTO();
+    }
+    buffer_io_reap(io);
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+#else
+
+static void buffer_io_ring_destroy(buffer_io *io) {
+  (void)io;
+}
+
+static int32_t buffer_io_ring_init(buffer_io *io, uint32_t entries) {
+  (void)io;
+  (void)entries;
+  return -1;
+}
+
+static void buffer_io_submit(buffer_io *io, uint32_t index) {
+  buffer_io_slot *slot = &io->slots[index];
+  uint32_t count;
+  for (count = 0; count * io->chunk_size < slot->size; count++) {
+    slot->results[count] = -EAGAIN;
+  }
+  slot->active = true;
+  slot->pending = 0;
+}
+
+static int32_t buffer_io_wait(buffer_io *io, buffer_io_slot *slot) {
+  (void)io;
+  (void)slot;
+  return 0;
+}
+
+#endif /* BUFFER_IO_URING */
+
+static int32_t buffer_io_set_direct(buffer_io *io, bool direct) {
+  if (io->direct == direct) {
+    return 0;
+  }
+  if (fcntl(io->file, F_SETFL, direct ? io->flags | O_DIRECT : io->flags) < 0) {
+    return -1;
+  }
+  io->direct = direct;
+  return 0;
+}
+
+static void buffer_io_release(buffer_io *io) {
+  uint32_t i;
+  buffer_io_ring_destroy(io);
+  for (i = 0; i < BUFFER_IO_SLOTS; i++) {
+    FREE(io->slots[i].memory);
+  }
+  FREE(io);
+}
+
+/*
+ * Move len bytes of slot from position from with plain calls. Used when
+ * ring or O_DIRECT refused request, O_DIRECT is dropped if it is the cause.
+ */
+static int64_t buffer_io_plain(buffer_io *io, buffer_io_slot *slot,
+                               uint64_t from, uint64_t len) {
+  uint64_t done = 0;
+  while (done < len) {
+    uint8_t *memory = &slot->memory[from + done];
+    off_t offset = slot->offset + from + done;
+    ssize_t result = slot->write ?
+                     pwrite(io->file, memory, len - done, offset) :
+                     pread(io->file, memory, len - done, offset);
+    if (result < 0 && errno == EINVAL && io->direct) {
+      if (buffer_io_set_direct(io, false) < 0) {
+        ERROR_GOTO();
+      }
+      continue;
+    }
+    if (result < 0) {
+      eprintf(slot->write ? "Cannot write to file\n" :
+                            "Cannot read from file\n");
+      ERROR_GOTO();
+    }
+    if (!result) {
+      break;
+    }
+    done += result;
+  }
+  return done;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Wait for requests of slot and redo failed ones with plain calls.
+ * Return count of bytes from start of slot, short only at end of file.
+ */
+static int64_t buffer_io_complete(buffer_io *io, uint32_t index) {
+  buffer_io_slot *slot = &io->slots[index];
+  uint64_t done = 0;
+  uint32_t count;
+
+  if (!slot->active) {
+    return 0;
+  }
+  slot->active = false;
+  if (buffer_io_wait(io, slot) < 0) {
+    ERROR_GOTO();
+  }
+  for (count = 0; done < slot->size; count++) {
+    uint64_t len = slot->size - done < io->chunk_size ?
+                   slot->size - done : io->chunk_size;
+    int64_t result = slot->results[count];
+    if (result < 0 || (slot->write && (uint64_t)result < len)) {
+      result = result < 0 ? 0 : result;
+      int64_t rest = buffer_io_plain(io, slot, done + result, len - result);
+      if (rest < 0) {
+        ERROR_GOTO();
+      }
+      result += rest;
+    }
+    done += result;
+    if ((uint64_t)result < len) {
+      break;
+    }
+  }
+  if (slot->write && done < slot->size) {
+    eprintf("Cannot write to file\n");
+    ERROR_GOTO();
+  }
+  return done;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static void buffer_io_fill(buffer_io *io, uint32_t index, uint64_t size,
+                           bool write) {
+  buffer_io_slot *slot = &io->slots[index];
+  slot->offset = io->offset;
+  slot->size = size;
+  slot->write = write;
+  io->offset += size;
+  buffer_io_submit(io, index);
+}
+
+/*
+ * Take file position on first request after attach or finish.
+ */
+static int32_t buffer_io_start(buffer_io *io, bool writing) {
+  off_t position = lseek(io->file, 0, SEEK_CUR);
+  if (position < 0) {
+    ERROR_GOTO();
+  }
+  io->started = true;
+  io->writing = writing;
+  io->eof = false;
+  io->position = position;
+  io->offset = writing ? position : position - position % BUFFER_IO_ALIGN;
+  io->skip = position - io->offset;
+  if (io->offset % BUFFER_IO_ALIGN == 0) {
+    buffer_io_set_direct(io, true);
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+int32_t buffer_io_attach(buffer_t *buff, uint32_t depth) {
+  uint64_t capacity = buff->buffer_capacity -
+                      buff->buffer_capacity % BUFFER_IO_ALIGN;
+  uint64_t memory_size = (capacity + BUFF_SLACK_SIZE + BUFFER_IO_ALIGN - 1) /
+                         BUFFER_IO_ALIGN * BUFFER_IO_ALIGN;
+  buffer_io *io = NULL;
+  uint32_t i;
+
+  if (buff->file < 0 || buff->io || !capacity) {
+    return -1;
+  }
+  if (depth < 1) {
+    depth = 1;
+  } else if (depth > BUFFER_IO_MAX_DEPTH) {
+    depth = BUFFER_IO_MAX_DEPTH;
+  }
+  io = CALLOC(1, sizeof(*io));
+  io->ring = -1;
+  io->file = buff->file;
+  io->flags = fcntl(buff->file, F_GETFL);
+  if (io->flags < 0) {
+    ERROR_GOTO();
+  }
+  io->flags &= ~O_DIRECT;
+  if (buffer_io_set_direct(io, true) < 0 || buffer_io_set_direct(io, false) < 0 ||
+      buffer_io_ring_init(io, depth * BUFFER_IO_SLOTS) < 0) {
+    ERROR_GOTO();
+  }
+  io->depth = depth;
+  io->chunk_size = (capacity / depth + BUFFER_IO_ALIGN - 1) /
+                   BUFFER_IO_ALIGN * BUFFER_IO_ALIGN;
+  for (i = 0; i < BUFFER_IO_SLOTS; i++) {
+    void *memory;
+    if (posix_memalign(&memory, BUFFER_IO_ALIGN, memory_size)) {
+      ERROR_GOTO();
+    }
+    io->slots[i].memory = memory;
+    memset(memory, 0, sizeof(uint64_t));
+    memset(&io->slots[i].memory[capacity], 0, memory_size - capacity);
+  }
+
+  FREE(buff->buffer);
+  buff->buffer = io->slots[0].memory;
+  buff->buffer_capacity = capacity;
+  buff->io = io;
+  return 0;
+_err:
+  if (io) {
+    buffer_io_release(io);
+  }
+  ERROR_RETURN(-1);
+}
+
+int64_t buffer_io_read(buffer_t *buff) {
+  buffer_io *io = buff->io;
+  uint32_t next = io->current ^ 1;
+  int64_t size;
+
+  if (!io->started) {
+    if (buffer_io_start(io, false) < 0) {
+      ERROR_GOTO();
+    }
+    buffer_io_fill(io, next, buff->buffer_capacity, false);
+  }
+  size = buffer_io_complete(io, next);
+  if (size < 0) {
+    ERROR_GOTO();
+  }
+  if ((uint64_t)size < io->slots[next].size) {
+    io->eof = true;
+  }
+  io->current = next;
+  buff->buffer = io->slots[next].memory;
+  /* Slot given before is free now, read ahead into it. */
+  if (!io->eof) {
+    buffer_io_fill(io, next ^ 1, buff->buffer_capacity, false);
+  }
+  if (io->skip) {
+    uint64_t skip = (uint64_t)size < io->skip ? (uint64_t)size : io->skip;
+    memmove(buff->buffer, &buff->buffer[skip], size - skip);
+    size -= skip;
+    io->skip = 0;
+  }
+  io->position += size;
+  return size;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+int64_t buffer_io_write(buffer_t *buff, uint64_t size) {
+  buffer_io *io = buff->io;
+  uint32_t next = io->current ^ 1;
+
+  if (!io->started && buffer_io_start(io, true) < 0) {
+    ERROR_GOTO();
+  }
+  if (io->direct && size == buff->buffer_capacity) {
+    buffer_io_fill(io, io->current, size, true);
+    /* Wait for write behind of other slot before it is reused. */
+    if (buffer_io_complete(io, next) < 0) {
+      ERROR_GOTO();
+    }
+    io->current = next;
+    buff->buffer = io->slots[next].memory;
+    return size;
+  }
+  /* Partial buffer can not go with O_DIRECT, it ends direct writing. */
+  if (buffer_io_finish(buff) < 0) {
+    ERROR_GOTO();
+  }
+  WRITE(buff->buffer, sizeof(*buff->buffer), size, io->file);
+  return size;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+int32_t buffer_io_finish(buffer_t *buff) {
+  buffer_io *io = buff->io;
+  uint32_t i;
+
+  for (i = 0; i < BUFFER_IO_SLOTS; i++) {
+    if (buffer_io_complete(io, i) < 0) {
+      ERROR_GOTO();
+    }
+  }
+  if (buffer_io_set_direct(io, false) < 0) {
+    ERROR_GOTO();
+  }
+  if (io->started) {
+    io->started = false;
+    if (lseek(io->file, io->writing ? io->offset : io->position,
+              SEEK_SET) < 0) {
+      ERROR_GOTO();
+    }
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+void buffer_io_destroy(buffer_t *buff) {
+  buffer_io_finish(buff);
+  buffer_io_release(buff->io);
+  buff->io = NULL;
+  buff->buffer = NULL;
+}
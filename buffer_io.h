@@ -0,0 +1,109 @@
+/**
+ * @file       buffer_io.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for direct I/O backend of buffer.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef BUFFER_IO_H_
+#define BUFFER_IO_H_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "error_handler.h"
+#include "macros.h"
+#include "buffer.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) &&                      \
+    __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define BUFFER_IO_URING 1
+#endif
+
+
+#define BUFFER_IO_ALIGN 4096                /// Alignment of O_DIRECT I/O
+#define BUFFER_IO_DEFAULT_DEPTH 8           /// Requests per buffer if not set
+#define BUFFER_IO_MAX_DEPTH 64              /// Largest requests per buffer
+#define BUFFER_IO_SLOTS 2                   /// Buffer in use and in flight
+
+ /**
+  * @struct buffer_io_slot
+  * @brief This struct store one aligned buffer and its requests
+  * @details Buffer is split into requests of chunk size, so several of them
+  * are in flight on device at once.
+  */
+typedef struct buffer_io_slot {
+  uint8_t *memory;                  /**< Aligned memory of buffer */
+  uint64_t offset;                  /**< File offset of first byte */
+  uint64_t size;                    /**< Requested bytes */
+  bool     active;                  /**< Requests were submitted */
+  bool     write;                   /**< Requests are writes */
+  uint32_t pending;                 /**< Requests not completed */
+  int32_t  results[BUFFER_IO_MAX_DEPTH]; /**< Result of each request */
+} buffer_io_slot;
+
+ /**
+  * @struct buffer_io
+  * @brief This struct store io_uring and buffers of one buffer_t
+  * @details While caller works on one slot, other slot is read ahead or
+  * written behind. O_DIRECT is set on file only between first request
+  * and finish, so plain reads and writes of headers are not affected.
+  */
+typedef struct buffer_io {
+  int      ring;                    /**< io_uring file */
+  int      file;                    /**< File of buffer */
+  void     *sq_map;                 /**< Mapped submission ring */
+  void     *cq_map;                 /**< Mapped completion ring */
+  uint64_t sq_map_size;             /**< Size of sq_map */
+  uint64_t cq_map_size;             /**< Size of cq_map */
+  uint64_t sqes_size;               /**< Size of sqes */
+#ifdef BUFFER_IO_URING
+  struct io_uring_sqe *sqes;        /**< Submission entries */
+  struct io_uring_cqe *cqes;        /**< Completion entries */
+#endif
+  uint32_t *sq_tail;                /**< Tail of submission ring */
+  uint32_t *sq_mask;                /**< Mask of submission ring */
+  uint32_t *sq_array;               /**< Indexes of submission ring */
+  uint32_t *cq_head;                /**< Head of completion ring */
+  uint32_t *cq_tail;                /**< Tail of completion ring */
+  uint32_t *cq_mask;                /**< Mask of completion ring */
+  uint32_t depth;                   /**< Requests per slot */
+  uint64_t chunk_size;              /**< Bytes per request */
+  int      flags;                   /**< File flags without O_DIRECT */
+  bool     direct;                  /**< O_DIRECT is set on file */
+  bool     started;                 /**< Position of file is taken */
+  bool     eof;                     /**< Last read was short */
+  bool     writing;                 /**< Buffer writes file */
+  uint32_t current;                 /**< Slot given to caller */
+  uint64_t offset;                  /**< Offset of next request */
+  uint64_t position;                /**< Offset after caller data */
+  uint64_t skip;                    /**< Bytes before start of first read */
+  buffer_io_slot slots[BUFFER_IO_SLOTS]; /**< Buffers */
+} buffer_io;
+
+/**
+ * @brief Attach direct I/O backend to file buffer
+ * @details Buffer memory is replaced by aligned slots and capacity is
+ * rounded down to BUFFER_IO_ALIGN. Full buffers are read and written
+ * through io_uring with O_DIRECT, depth requests per buffer. If io_uring
+ * or O_DIRECT is not available buffer is left on plain path.
+ *
+ * @param buff Buffer with opened file
+ * @param depth Requests in flight per buffer
+ * @return 0 on success and -1 if plain path is kept
+ */
+int32_t buffer_io_attach(buffer_t *buff, uint32_t depth);
+
+#endif /* BUFFER_IO_H_ */
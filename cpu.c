@@ -0,0 +1,52 @@
+#include "cpu.h"
+
+static const char *cpu_path_names[] = { "scalar", "sse4", "avx2", "bmi2" };
+
+static cpu_path_t cpu_detect() {
+#ifdef CPU_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2")) {
+    return CPU_PATH_BMI2;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return CPU_PATH_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return CPU_PATH_SSE4;
+  }
+#endif
+  return CPU_PATH_SCALAR;
+}
+
+cpu_path_t cpu_path() {
+  static int32_t selected = -1;
+  if (selected >= 0) {
+    return selected;
+  }
+
+  cpu_path_t best = cpu_detect();
+  const char *forced = getenv(CPU_PATH_ENV);
+  selected = best;
+  if (forced) {
+    cpu_path_t path;
+    for (path = CPU_PATH_SCALAR; path <= CPU_PATH_BMI2; path++) {
+      if (!strcmp(forced, cpu_path_names[path])) {
+        break;
+      }
+    }
+    if (path > CPU_PATH_BMI2) {
+      eprintf("Unknown %s=%s, using %s\n", CPU_PATH_ENV, forced,
+              cpu_path_names[best]);
+    } else if (path > best) {
+      eprintf("CPU does not support %s, using %s\n", forced,
+              cpu_path_names[best]);
+    } else {
+      selected = path;
+    }
+  }
+  return selected;
+}
+
+const char* cpu_path_name(cpu_path_t path) {
+  return cpu_path_names[path];
+}
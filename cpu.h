@@ -0,0 +1,53 @@
+/**
+ * @file       cpu.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for choosing kernels by CPU features.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef CPU_H_
+#define CPU_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error_handler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_X86 1
+#endif
+
+
+#define CPU_PATH_ENV "HUFF_CPU_PATH"        /// Variable to force kernel path
+
+typedef enum {
+  CPU_PATH_SCALAR = 0,              /**< Portable C */
+  CPU_PATH_SSE4 = 1,                /**< SSE4.2 */
+  CPU_PATH_AVX2 = 2,                /**< AVX2 */
+  CPU_PATH_BMI2 = 3,                /**< AVX2 and BMI2 */
+} cpu_path_t;
+
+/**
+ * @brief Get kernel path
+ * @details On first call detect CPU features with cpuid and choose best
+ * path. Path can be forced by HUFF_CPU_PATH=scalar|sse4|avx2|bmi2, path
+ * that CPU does not support is lowered to best supported.
+ *
+ * @return Kernel path
+ */
+cpu_path_t cpu_path();
+
+/**
+ * @brief Get name of kernel path
+ *
+ * @param path Kernel path
+ * @return Name of path
+ */
+const char* cpu_path_name(cpu_path_t path);
+
+#endif /* CPU_H_ */
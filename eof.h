@@ -23,7 +23,9 @@
       })
 
 /**
- * Macros to writing end of file and metainfo
+ * Macros to writing end of file and metainfo.
+ * File size is stored as 64 bit little endian. Padding chunk after codes
+ * is written as zeros.
  */
 #define BUFFER_WRITE_EOF(buff, file_size)                                      \
       ({                                                                       \
@@ -31,10 +33,12 @@
                                 UINT64_BIT - buff->bit_position;               \
         buff->buffer64[buff->buffer_position] =                                \
                                 htobe64(buff->buffer64[buff->buffer_position]);\
+        buff->buffer64[buff->buffer_position + 1] = 0;                         \
         buff->buffer_position+=2;                                              \
         BUFFER_WRITE(buff);                                                    \
         BUFFER_REWIND(buff);                                                   \
-        WRITE(&file_size, sizeof(file_size), 1, buff->file);                   \
+        uint64_t le_file_size = htole64(file_size);                            \
+        WRITE(&le_file_size, sizeof(le_file_size), 1, buff->file);             \
       })
 
 /**
@@ -44,7 +48,7 @@
       ({                                                                       \
         uint64_t file_size;                                                    \
         READ(&file_size, sizeof(file_size), 1, buff->file);                    \
-        file_size;                                                             \
+        le64toh(file_size);                                                    \
       })
 
 
@@ -0,0 +1,185 @@
+#include "estimate.h"
+
+/*
+ * Build tree from histogram like encoder does and compute size of huffman
+ * file: size chunk, tree and codes, last chunk and padding chunk.
+ */
+static int32_t estimate_histogram(const uint64_t hist[], estimate_t *est) {
+  huff_node *hnt[MAX_SYMBOLS] = {NULL};
+  int32_t symbols_count = 0;
+  double entropy = 0;
+  uint32_t s;
+
+  if (huff_nodes_init_histogram(hnt, hist) < 0) {
+    ERROR_GOTO();
+  }
+  symbols_count = construct_tree(hnt);
+
+  double scale = est->scanned ? (double)est->size / est->scanned : 0;
+  uint64_t bits = huff_tree_size(hnt[0]) +
+                  (uint64_t)(huff_tree_cost(hnt[0], 0) * scale + 0.5);
+  est->compressed = (ESTIMATE_HEADER_CHUNKS + bits / UINT64_BIT) *
+                    sizeof(uint64_t);
+
+  for (s = 0; s < MAX_SYMBOLS; s++) {
+    if (hist[s]) {
+      double p = (double)hist[s] / est->scanned;
+      entropy -= p * log2(p);
+    }
+  }
+  est->entropy = entropy;
+
+  huff_nodes_destroy(hnt, symbols_count);
+  return 0;
+_err:
+  ERROR_MSG();
+  huff_nodes_destroy(hnt, symbols_count);
+  ERROR_RETURN(-1);
+}
+
+int32_t estimate_file(const char *path, uint32_t stride, uint8_t *buffer,
+                      estimate_t *est) {
+  uint64_t hist[MAX_SYMBOLS] = {0};
+  struct stat st;
+  ssize_t readed;
+  int fildes = -1;
+
+  memset(est, 0, sizeof(*est));
+  fildes = OPEN(path, O_RDONLY);
+  if (fstat(fildes, &st) < 0) {
+    ERROR_GOTO();
+  }
+  est->size = st.st_size;
+
+  if (stride <= 1) {
+    posix_fadvise(fildes, 0, 0, POSIX_FADV_SEQUENTIAL);
+    while ((readed = READ(buffer, sizeof(*buffer), ESTIMATE_READ_SIZE,
+                          fildes)) > 0) {
+      count_symbol_frequency(hist, buffer, readed);
+      est->scanned += readed;
+    }
+    est->size = est->scanned;
+  } else {
+    uint64_t step = (uint64_t)stride * ESTIMATE_SAMPLE_SIZE;
+    uint64_t offset;
+    posix_fadvise(fildes, 0, 0, POSIX_FADV_RANDOM);
+    for (offset = 0; offset < est->size; offset += step) {
+      if (lseek(fildes, offset, SEEK_SET) < 0) {
+        ERROR_GOTO();
+      }
+      readed = READ(buffer, sizeof(*buffer), ESTIMATE_SAMPLE_SIZE, fildes);
+      count_symbol_frequency(hist, buffer, readed);
+      est->scanned += readed;
+    }
+  }
+
+  CLOSE(fildes);
+  return estimate_histogram(hist, est);
+_err:
+  ERROR_MSG();
+  if (fildes >= 0) {
+    close(fildes);
+  }
+  ERROR_RETURN(-1);
+}
+
+static void* estimate_worker(void *arg) {
+  estimate_pool *pool = arg;
+  uint8_t *buffer = NULL;
+  uint32_t i;
+
+  buffer = MALLOC(ESTIMATE_READ_SIZE);
+  while (true) {
+    pthread_mutex_lock(&pool->lock);
+    i = pool->next < pool->count ? pool->next++ : pool->count;
+    pthread_mutex_unlock(&pool->lock);
+    if (i == pool->count) {
+      break;
+    }
+    pool->results[i].status = estimate_file(pool->paths[i], pool->stride,
+                                            buffer, &pool->results[i]);
+  }
+  FREE(buffer);
+  return NULL;
+_err:
+  ERROR_MSG();
+  return NULL;
+}
+
+static double estimate_ratio(uint64_t compressed, uint64_t size) {
+  return size ? (double)compressed / size : 0;
+}
+
+int32_t huffman_estimate(char *const paths[], uint32_t count,
+                         uint32_t workers_count, uint32_t stride) {
+  estimate_pool pool = {
+    .paths = paths,
+    .count = count,
+    .stride = stride,
+  };
+  pthread_t *workers = NULL;
+  uint64_t total_size = 0;
+  uint64_t total_compressed = 0;
+  uint32_t started = 0;
+  int32_t ret = 0;
+  uint32_t i;
+
+  if (!workers_count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers_count = cpus > 0 ? cpus : 1;
+  }
+  if (workers_count > count) {
+    workers_count = count ? count : 1;
+  }
+  pool.results = CALLOC(count + 1, sizeof(*pool.results));
+  for (i = 0; i < count; i++) {
+    pool.results[i].status = -1;
+  }
+  workers = CALLOC(workers_count, sizeof(*workers));
+  pthread_mutex_init(&pool.lock, NULL);
+
+  for (started = 0; started < workers_count; started++) {
+    if (pthread_create(&workers[started], NULL, estimate_worker, &pool)) {
+      eprintf("Cannot start worker\n");
+      break;
+    }
+  }
+  if (!started) {
+    estimate_worker(&pool);
+  }
+  for (i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  pthread_mutex_destroy(&pool.lock);
+
+  for (i = 0; i < count; i++) {
+    estimate_t *est = &pool.results[i];
+    if (est->status < 0) {
+      eprintf("%s: failed\n", paths[i]);
+      ret = -1;
+      continue;
+    }
+    printf("%s: %llu -> %llu bytes, ratio %.3f, entropy %.3f bits/byte%s\n",
+           paths[i], (unsigned long long)est->size,
+           (unsigned long long)est->compressed,
+           estimate_ratio(est->compressed, est->size), est->entropy,
+           est->scanned < est->size ? ", sampled" : "");
+    total_size += est->size;
+    total_compressed += est->compressed;
+  }
+  if (count > 1) {
+    printf("total: %llu -> %llu bytes, ratio %.3f\n",
+           (unsigned long long)total_size,
+           (unsigned long long)total_compressed,
+           estimate_ratio(total_compressed, total_size));
+  }
+
+  FREE(workers);
+  FREE(pool.results);
+  return ret;
+_err:
+  ERROR_MSG();
+  FREE(workers);
+  FREE(pool.results);
+  ERROR_RETURN(-1);
+}
@@ -0,0 +1,87 @@
+/**
+ * @file       estimate.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for compressibility estimation of files.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef ESTIMATE_H_
+#define ESTIMATE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "error_handler.h"
+#include "macros.h"
+#include "buffer.h"
+#include "huff_nodes.h"
+
+
+#define ESTIMATE_READ_SIZE (1024*1024)      /// Read size of each worker
+#define ESTIMATE_SAMPLE_SIZE (64*1024)      /// Size of one sampled part
+#define ESTIMATE_HEADER_CHUNKS 3            /// Size, last and padding chunk
+
+ /**
+  * @struct estimate_t
+  * @brief This struct store estimation of one file
+  */
+typedef struct estimate_t {
+  uint64_t size;                    /**< Size of file */
+  uint64_t scanned;                 /**< Bytes that were counted */
+  uint64_t compressed;              /**< Size of huffman file */
+  double   entropy;                 /**< Bits per byte */
+  int32_t  status;                  /**< 0 on success and -1 if faild */
+} estimate_t;
+
+ /**
+  * @struct estimate_pool
+  * @brief This struct store files shared by estimation workers
+  */
+typedef struct estimate_pool {
+  char *const *paths;               /**< Files to estimate */
+  estimate_t *results;              /**< Estimation of each file */
+  uint32_t count;                   /**< Count of files */
+  uint32_t next;                    /**< First file not taken by worker */
+  uint32_t stride;                  /**< Count one part of stride parts */
+  pthread_mutex_t lock;             /**< Guard of next */
+} estimate_pool;
+
+/**
+ * @brief Estimate size of huffman file without encoding
+ * @details Only histogram and code lengths are computed. With stride 1
+ * whole file is counted and size is exact. Else one ESTIMATE_SAMPLE_SIZE
+ * part of every stride parts is counted and size is scaled.
+ *
+ * @param path Path to file
+ * @param stride Sampling stride, 0 or 1 is whole file
+ * @param buffer Memory for reading of ESTIMATE_READ_SIZE bytes
+ * @param est Result
+ * @return 0 on success and -1 if faild
+ */
+int32_t estimate_file(const char *path, uint32_t stride, uint8_t *buffer,
+                      estimate_t *est);
+
+/**
+ * @brief Estimate files in parallel and print results
+ * @details Each line has size, estimated huffman size, ratio and entropy
+ * of one file. Total is printed for more than one file.
+ *
+ * @param paths Files to estimate
+ * @param count Count of files
+ * @param workers_count Count of threads, 0 is count of CPUs
+ * @param stride Sampling stride, 0 or 1 is whole file
+ * @return 0 if all files were estimated and -1 if some failed
+ */
+int32_t huffman_estimate(char *const paths[], uint32_t count,
+                         uint32_t workers_count, uint32_t stride);
+
+#endif /* ESTIMATE_H_ */
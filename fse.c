@@ -0,0 +1,275 @@
+#include "fse.h"
+
+#define FSE_TABLE_MASK (FSE_TABLE_SIZE - 1)
+#define FSE_TABLE_STEP ((FSE_TABLE_SIZE >> 1) + (FSE_TABLE_SIZE >> 3) + 3)
+
+/**
+ * @struct fse_encode_symbol
+ * @brief This struct store encoder transform for one symbol
+ */
+typedef struct fse_encode_symbol {
+  int32_t  delta_find_state;        /**< Offset of symbol states in table */
+  uint32_t delta_numbits;           /**< Bias to get count of bits by state */
+} fse_encode_symbol;
+
+/**
+ * @struct fse_bit_writer
+ * @brief This struct store forward bitstream
+ */
+typedef struct fse_bit_writer {
+  uint64_t container;               /**< Bits that are not flushed */
+  uint32_t numbits;                 /**< Count of bits in container */
+  uint8_t *dst;                     /**< Output memory */
+  uint64_t position;                /**< Count of written bytes */
+  uint64_t size;                    /**< Size of output memory */
+} fse_bit_writer;
+
+
+/**
+ * Macros to append bits to writer.
+ */
+#define FSE_WRITER_APPEND(writer, bits, count)                                 \
+      ({                                                                       \
+        writer.container |= ((uint64_t)(bits) & ((1ULL << (count)) - 1))       \
+                                                     << writer.numbits;        \
+        writer.numbits += (count);                                             \
+      })
+
+/**
+ * Macros to flush full bytes of writer.
+ */
+#define FSE_WRITER_FLUSH(writer)                                               \
+      ({                                                                       \
+        while (writer.numbits >= CHAR_BIT) {                                   \
+          writer.dst[writer.position++] = writer.container;                    \
+          writer.container >>= CHAR_BIT;                                       \
+          writer.numbits -= CHAR_BIT;                                          \
+        }                                                                      \
+      })
+
+/**
+ * Macros to take count bits from end of backward bitstream.
+ */
+#define FSE_READER_TAKE(src, bitpos, count)                                    \
+      ({                                                                       \
+        uint32_t tmp_bits;                                                     \
+        bitpos -= (count);                                                     \
+        memcpy(&tmp_bits, &src[bitpos >> 3], sizeof(tmp_bits));                \
+        (le32toh(tmp_bits) >> (bitpos & 7)) & ((1U << (count)) - 1);           \
+      })
+
+
+static uint32_t fse_highbit(uint32_t value) {
+  return 31 - __builtin_clz(value);
+}
+
+static void fse_spread_symbols(const uint16_t norm[], uint8_t table_symbol[]) {
+  uint32_t position = 0;
+  uint32_t s;
+  uint32_t i;
+  for (s = 0; s < MAX_SYMBOLS; s++) {
+    for (i = 0; i < norm[s]; i++) {
+      table_symbol[position] = s;
+      position = (position + FSE_TABLE_STEP) & FSE_TABLE_MASK;
+    }
+  }
+}
+
+static uint32_t fse_max_symbol(const uint16_t norm[]) {
+  uint32_t max_symbol = MAX_SYMBOLS - 1;
+  while (max_symbol && !norm[max_symbol]) {
+    max_symbol--;
+  }
+  return max_symbol;
+}
+
+static uint64_t fse_write_header(const uint16_t norm[], uint8_t *dst) {
+  uint32_t max_symbol = fse_max_symbol(norm);
+  uint64_t position = 0;
+  uint32_t s;
+  dst[position++] = FSE_TABLE_LOG;
+  dst[position++] = max_symbol;
+  for (s = 0; s <= max_symbol; s++) {
+    if (norm[s] < 0x80) {
+      dst[position++] = norm[s];
+    } else {
+      dst[position++] = (norm[s] & 0x7f) | 0x80;
+      dst[position++] = norm[s] >> 7;
+    }
+  }
+  return position;
+}
+
+static int64_t fse_read_header(const uint8_t *src, uint64_t src_size, uint16_t norm[]) {
+  uint64_t position = 2;
+  uint32_t total = 0;
+  uint32_t s;
+  if (src_size < 2 || src[0] != FSE_TABLE_LOG) {
+    return -1;
+  }
+  memset(norm, 0, MAX_SYMBOLS * sizeof(*norm));
+  for (s = 0; s <= src[1]; s++) {
+    if (position >= src_size) {
+      return -1;
+    }
+    norm[s] = src[position] & 0x7f;
+    if (src[position++] & 0x80) {
+      norm[s] |= src[position++] << 7;
+    }
+    total += norm[s];
+  }
+  return total == FSE_TABLE_SIZE ? (int64_t)position : -1;
+}
+
+uint32_t fse_normalize(const uint64_t hist[], uint64_t total, uint16_t norm[]) {
+  uint32_t symbols_count = 0;
+  uint32_t sum = 0;
+  uint32_t largest = 0;
+  uint32_t s;
+  for (s = 0; s < MAX_SYMBOLS; s++) {
+    norm[s] = 0;
+    if (!hist[s]) {
+      continue;
+    }
+    norm[s] = (hist[s] * FSE_TABLE_SIZE + total / 2) / total;
+    if (!norm[s]) {
+      norm[s] = 1;
+    }
+    if (norm[s] > norm[largest]) {
+      largest = s;
+    }
+    sum += norm[s];
+    symbols_count++;
+  }
+  if (!symbols_count || symbols_count > FSE_TABLE_SIZE) {
+    return symbols_count;
+  }
+  while (sum > FSE_TABLE_SIZE) {
+    uint32_t max_s = largest;
+    for (s = 0; s < MAX_SYMBOLS; s++) {
+      if (norm[s] > norm[max_s]) {
+        max_s = s;
+      }
+    }
+    norm[max_s]--;
+    sum--;
+  }
+  norm[largest] += FSE_TABLE_SIZE - sum;
+  return symbols_count;
+}
+
+uint64_t fse_estimate_bits(const uint64_t hist[], const uint16_t norm[]) {
+  double bits = 0;
+  uint32_t s;
+  for (s = 0; s < MAX_SYMBOLS; s++) {
+    if (hist[s]) {
+      bits += hist[s] * (FSE_TABLE_LOG - log2(norm[s]));
+    }
+  }
+  uint8_t header[FSE_MAX_HEADER_SIZE];
+  return (uint64_t)bits + FSE_TABLE_LOG + CHAR_BIT +
+         fse_write_header(norm, header) * CHAR_BIT;
+}
+
+int64_t fse_encode(const uint8_t *src, uint64_t size, const uint16_t norm[],
+                   uint8_t *dst, uint64_t dst_size) {
+  uint8_t table_symbol[FSE_TABLE_SIZE];
+  uint16_t state_table[FSE_TABLE_SIZE];
+  uint32_t cumul[MAX_SYMBOLS];
+  fse_encode_symbol transform[MAX_SYMBOLS];
+  fse_bit_writer writer = { 0, 0, dst, 0, dst_size };
+  uint32_t total = 0;
+  uint32_t s;
+  uint32_t u;
+
+  if (dst_size < FSE_MAX_HEADER_SIZE + sizeof(uint64_t)) {
+    return -1;
+  }
+  writer.position = fse_write_header(norm, dst);
+
+  fse_spread_symbols(norm, table_symbol);
+  for (s = 0; s < MAX_SYMBOLS; s++) {
+    cumul[s] = total;
+    if (norm[s] == 1) {
+      transform[s].delta_numbits = (FSE_TABLE_LOG << 16) - FSE_TABLE_SIZE;
+      transform[s].delta_find_state = total - 1;
+    } else if (norm[s]) {
+      uint32_t max_bits_out = FSE_TABLE_LOG - fse_highbit(norm[s] - 1);
+      uint32_t min_state_plus = (uint32_t)norm[s] << max_bits_out;
+      transform[s].delta_numbits = (max_bits_out << 16) - min_state_plus;
+      transform[s].delta_find_state = total - norm[s];
+    }
+    total += norm[s];
+  }
+  for (u = 0; u < FSE_TABLE_SIZE; u++) {
+    state_table[cumul[table_symbol[u]]++] = FSE_TABLE_SIZE + u;
+  }
+
+  uint32_t state = FSE_TABLE_SIZE;
+  uint64_t limit = dst_size - sizeof(uint64_t);
+  while (size--) {
+    const fse_encode_symbol *tr = &transform[src[size]];
+    uint32_t numbits = (state + tr->delta_numbits) >> 16;
+    FSE_WRITER_APPEND(writer, state, numbits);
+    state = state_table[(state >> numbits) + tr->delta_find_state];
+    FSE_WRITER_FLUSH(writer);
+    if (writer.position > limit) {
+      return -1;
+    }
+  }
+  FSE_WRITER_APPEND(writer, state, FSE_TABLE_LOG);
+  FSE_WRITER_APPEND(writer, 1, 1);
+  FSE_WRITER_FLUSH(writer);
+  if (writer.numbits) {
+    dst[writer.position++] = writer.container;
+  }
+  return writer.position;
+}
+
+int32_t fse_decode(const uint8_t *src, uint64_t src_size, uint8_t *dst,
+                   uint64_t size) {
+  uint16_t norm[MAX_SYMBOLS];
+  uint16_t symbol_next[MAX_SYMBOLS];
+  uint8_t table_symbol[FSE_TABLE_SIZE];
+  fse_decode_entry table[FSE_TABLE_SIZE];
+  uint32_t u;
+
+  int64_t header_size = fse_read_header(src, src_size, norm);
+  if (header_size < 0 || (uint64_t)header_size >= src_size) {
+    eprintf("Corrupted FSE header\n");
+    return -1;
+  }
+
+  fse_spread_symbols(norm, table_symbol);
+  memcpy(symbol_next, norm, sizeof(norm));
+  for (u = 0; u < FSE_TABLE_SIZE; u++) {
+    uint8_t s = table_symbol[u];
+    uint32_t next_state = symbol_next[s]++;
+    table[u].symbol = s;
+    table[u].numbits = FSE_TABLE_LOG - fse_highbit(next_state);
+    table[u].new_state = (next_state << table[u].numbits) - FSE_TABLE_SIZE;
+  }
+
+  src += header_size;
+  src_size -= header_size;
+  if (!src[src_size - 1]) {
+    eprintf("Corrupted FSE bitstream\n");
+    return -1;
+  }
+  uint64_t bitpos = (src_size - 1) * CHAR_BIT + fse_highbit(src[src_size - 1]);
+  if (bitpos < FSE_TABLE_LOG) {
+    eprintf("Corrupted FSE bitstream\n");
+    return -1;
+  }
+  uint32_t state = FSE_READER_TAKE(src, bitpos, FSE_TABLE_LOG);
+  while (size--) {
+    const fse_decode_entry *entry = &table[state];
+    *dst++ = entry->symbol;
+    if (bitpos < entry->numbits) {
+      eprintf("Corrupted FSE bitstream\n");
+      return -1;
+    }
+    state = entry->new_state + FSE_READER_TAKE(src, bitpos, entry->numbits);
+  }
+  return 0;
+}
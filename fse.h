@@ -0,0 +1,88 @@
+/**
+ * @file       fse.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for table based ANS (FSE) coding.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef FSE_H_
+#define FSE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <math.h>
+#include "error_handler.h"
+#include "macros.h"
+#include "huff_codes.h"
+
+
+#define FSE_TABLE_LOG 11                    /// Log2 of state table size
+#define FSE_TABLE_SIZE (1 << FSE_TABLE_LOG)
+#define FSE_MAX_HEADER_SIZE (2 + 2 * MAX_SYMBOLS) /// Table log and counts
+
+ /**
+  * @struct fse_decode_entry
+  * @brief This struct store decoder transition for one state
+  */
+typedef struct fse_decode_entry {
+  uint16_t new_state;               /**< Base of next state */
+  uint8_t  symbol;                  /**< Decoded symbol */
+  uint8_t  numbits;                 /**< Count of bits to add to base */
+} fse_decode_entry;
+
+/**
+ * @brief Normalize symbol counts
+ * @details Scale counts so that they sum to FSE_TABLE_SIZE, each symbol
+ * that is present get at least 1.
+ *
+ * @param hist Count of each symbol
+ * @param total Count of all symbols
+ * @param norm Normalized counts
+ * @return Count of present symbols
+ */
+uint32_t fse_normalize(const uint64_t hist[], uint64_t total, uint16_t norm[]);
+
+/**
+ * @brief Estimate size of encoded data
+ * @details Sum of hist[s] * log2(FSE_TABLE_SIZE / norm[s]) and header.
+ *
+ * @param hist Count of each symbol
+ * @param norm Normalized counts
+ * @return Size in bits
+ */
+uint64_t fse_estimate_bits(const uint64_t hist[], const uint16_t norm[]);
+
+/**
+ * @brief Encode memory with normalized counts
+ * @details Write counts header and then bitstream. Symbols are encoded
+ * from last to first so decoder read them in order.
+ *
+ * @param src Data to encode
+ * @param size Size of data
+ * @param norm Normalized counts
+ * @param dst Memory for encoded data
+ * @param dst_size Size of dst
+ * @return Size of encoded data or -1 if it does not fit in dst
+ */
+int64_t fse_encode(const uint8_t *src, uint64_t size, const uint16_t norm[],
+                   uint8_t *dst, uint64_t dst_size);
+
+/**
+ * @brief Decode memory
+ * @details src must have 8 readable bytes after src_size.
+ *
+ * @param src Encoded data
+ * @param src_size Size of encoded data
+ * @param dst Memory for decoded data
+ * @param size Count of symbols to decode
+ * @return 0 on success and -1 if faild
+ */
+int32_t fse_decode(const uint8_t *src, uint64_t src_size, uint8_t *dst,
+                   uint64_t size);
+
+#endif /* FSE_H_ */
@@ -11,3 +11,97 @@ _err:
   ERROR_MSG();
   ERROR_RETURN(NULL);
 }
+
+void huff_codes_destroy(huff_code *hnct[]) {
+  size_t i;
+  for (i = 0; i < MAX_SYMBOLS; i++) {
+    FREE(hnct[i]);
+  }
+}
+
+huff_pair_table* huff_pair_table_init(huff_code *hnct[]) {
+  huff_pair_table *pairs = NULL;
+  uint32_t a, b;
+
+  for (a = 0; a < MAX_SYMBOLS; a++) {
+    if (hnct[a] && hnct[a]->numbits > HUFF_PAIR_MAX_BITS) {
+      return NULL;
+    }
+  }
+  pairs = MALLOC(sizeof(*pairs));
+  for (a = 0; a < MAX_SYMBOLS; a++) {
+    uint64_t *row = &pairs->entries[a << CHAR_BIT];
+    if (!hnct[a]) {
+      memset(row, 0, MAX_SYMBOLS * sizeof(*row));
+      continue;
+    }
+    for (b = 0; b < MAX_SYMBOLS; b++) {
+      if (!hnct[b]) {
+        row[b] = 0;
+        continue;
+      }
+      uint32_t numbits = hnct[a]->numbits + hnct[b]->numbits;
+      row[b] = (hnct[a]->bits << hnct[b]->numbits | hnct[b]->bits) |
+               (uint64_t)numbits << HUFF_PAIR_LEN_SHIFT;
+    }
+  }
+  return pairs;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(NULL);
+}
+
+huff_pair_table* huff_pair_table_destroy(huff_pair_table *pairs) {
+  FREE(pairs);
+  return pairs;
+}
+
+static inline __attribute__((always_inline))
+int32_t huff_codes_append_body(huff_code *hnct[], const huff_pair_table *pairs,
+                               const uint8_t *data, uint64_t size,
+                               buffer_t *buff_out) {
+  uint64_t i = 0;
+  if (pairs) {
+    for (; i + 1 < size; i += 2) {
+      uint64_t entry = pairs->entries[data[i] << CHAR_BIT | data[i + 1]];
+      uint64_t bits = entry & ((1ULL << HUFF_PAIR_LEN_SHIFT) - 1);
+      uint32_t numbits = entry >> HUFF_PAIR_LEN_SHIFT;
+      BUFFER_APPEND_BITS(buff_out, bits, numbits);
+    }
+  }
+  for (; i < size; i++) {
+    BUFFER_APPEND_HUFF_CODE(buff_out, hnct[data[i]]);
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int32_t huff_codes_append_generic(huff_code *hnct[],
+                                         const huff_pair_table *pairs,
+                                         const uint8_t *data, uint64_t size,
+                                         buffer_t *buff_out) {
+  return huff_codes_append_body(hnct, pairs, data, size, buff_out);
+}
+
+#ifdef CPU_X86
+__attribute__((target("bmi2")))
+static int32_t huff_codes_append_bmi2(huff_code *hnct[],
+                                      const huff_pair_table *pairs,
+                                      const uint8_t *data, uint64_t size,
+                                      buffer_t *buff_out) {
+  return huff_codes_append_body(hnct, pairs, data, size, buff_out);
+}
+#endif
+
+int32_t huff_codes_append(huff_code *hnct[], const huff_pair_table *pairs,
+                          const uint8_t *data, uint64_t size,
+                          buffer_t *buff_out) {
+#ifdef CPU_X86
+  if (cpu_path() == CPU_PATH_BMI2) {
+    return huff_codes_append_bmi2(hnct, pairs, data, size, buff_out);
+  }
+#endif
+  return huff_codes_append_generic(hnct, pairs, data, size, buff_out);
+}
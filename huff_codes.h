@@ -17,8 +17,12 @@
 #include <limits.h>
 #include "error_handler.h"
 #include "buffer.h"
+#include "cpu.h"
 
 #define MAX_SYMBOLS 256
+#define HUFF_PAIR_MAX_BITS 29               /// Longest code of pair table
+#define HUFF_PAIR_LEN_SHIFT 58              /// Length is in top bits of pair
+#define HUFF_PAIR_MIN_SIZE (1024*256)       /// Input that pays for table
 
 
 /**
@@ -30,6 +34,16 @@ typedef struct huff_code {
   uint32_t numbits;           /**<  Size of huffman code*/
 } huff_code;
 
+/**
+ * @struct huff_pair_table
+ * @brief This struct store codes of all symbol pairs
+ * @details Entry of pair a, b is at a << 8 | b. Low bits are code of a
+ * followed by code of b, bits from HUFF_PAIR_LEN_SHIFT are its length.
+ */
+typedef struct huff_pair_table {
+  uint64_t entries[MAX_SYMBOLS * MAX_SYMBOLS]; /**< Codes of pairs */
+} huff_pair_table;
+
 /**
  * @brief Create new huff code
  * @details Allocates memory for new struct and init
@@ -39,6 +53,48 @@ typedef struct huff_code {
  */
 huff_code *new_huff_code(huff_code code);
 
+/**
+ * @brief Free huff codes table
+ *
+ * @param hnct Huffman codes table
+ */
+void huff_codes_destroy(huff_code *hnct[]);
+
+/**
+ * @brief Create table of codes of symbol pairs
+ * @details Table is built only if every code has at most
+ * HUFF_PAIR_MAX_BITS bits, so code of pair fits one append.
+ *
+ * @param hnct Huffman codes table
+ * @return Pointer to table or NULL if codes are too long or failed
+ */
+huff_pair_table* huff_pair_table_init(huff_code *hnct[]);
+
+/**
+ * @brief Free table of codes of symbol pairs
+ *
+ * @param pairs Table or NULL
+ * @return NULL
+ */
+huff_pair_table* huff_pair_table_destroy(huff_pair_table *pairs);
+
+/**
+ * @brief Append codes of symbols to output buffer
+ * @details On BMI2 path shifts of bit writer use shlx/shrx. With pair
+ * table input is taken two symbols per step, odd last symbol is taken
+ * from hnct.
+ *
+ * @param hnct Huffman codes table
+ * @param pairs Table of pairs of hnct or NULL
+ * @param data Symbols to encode
+ * @param size Count of symbols
+ * @param buff_out Output buffer
+ * @return 0 on success and -1 if faild
+ */
+int32_t huff_codes_append(huff_code *hnct[], const huff_pair_table *pairs,
+                          const uint8_t *data, uint64_t size,
+                          buffer_t *buff_out);
+
 
 /**
  * Macros to append bit 0 to huff_code.
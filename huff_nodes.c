@@ -45,16 +45,167 @@ uint32_t huff_nodes_init(huff_node *hnf[]) {
   return 0;
 }
 
-int64_t clalculate_symbol_frequancy(huff_node *hnf[], buffer_t *buff) {
+int32_t huff_nodes_init_histogram(huff_node *hnf[], const uint64_t hist[]) {
+  size_t i;
+  for (i = 0; i < MAX_SYMBOLS; i++) {
+    hnf[i] = new_leaf_huff_node(i);
+    if (!hnf[i]) {
+      return -1;
+    }
+    hnf[i]->frequency = hist[i];
+  }
+  return 0;
+}
+
+void huff_tree_destroy(huff_node *hn) {
+  if (!hn) {
+    return;
+  }
+  if (!hn->is_leaf) {
+    huff_tree_destroy(hn->left);
+    huff_tree_destroy(hn->right);
+  }
+  free(hn);
+}
+
+void huff_nodes_destroy(huff_node *hnf[], uint32_t symbols_count) {
+  size_t i;
+  huff_tree_destroy(hnf[0]);
+  for (i = symbols_count ? symbols_count : 1; i < MAX_SYMBOLS; i++) {
+    FREE(hnf[i]);
+  }
+  hnf[0] = NULL;
+}
+
+uint64_t huff_tree_cost(huff_node *hn, uint32_t depth) {
+  if (!hn) {
+    return 0;
+  }
+  if (hn->is_leaf) {
+    return hn->frequency * depth;
+  }
+  return huff_tree_cost(hn->left, depth + 1) +
+         huff_tree_cost(hn->right, depth + 1);
+}
+
+uint64_t huff_tree_size(huff_node *hn) {
+  if (!hn) {
+    return 1;
+  }
+  if (hn->is_leaf) {
+    return 2 + CHAR_BIT;
+  }
+  return 2 + huff_tree_size(hn->left) + huff_tree_size(hn->right);
+}
+
+uint32_t huff_tree_depth(huff_node *hn) {
+  if (!hn || hn->is_leaf) {
+    return 0;
+  }
+  uint32_t left = huff_tree_depth(hn->left);
+  uint32_t right = huff_tree_depth(hn->right);
+  return 1 + (left > right ? left : right);
+}
+
+static void count_symbol_frequency_scalar(uint64_t hist[], const uint8_t *data,
+                                          uint64_t size) {
+  while (size--) {
+    hist[*data++]++;
+  }
+}
+
+static inline __attribute__((always_inline))
+void count_symbol_frequency_x4(uint32_t counts[][MAX_SYMBOLS],
+                               const uint8_t *data, uint64_t size) {
+  uint64_t word;
+  for (; size >= sizeof(word); size -= sizeof(word), data += sizeof(word)) {
+    memcpy(&word, data, sizeof(word));
+    counts[0][word & 0xff]++;
+    counts[1][(word >> 8) & 0xff]++;
+    counts[2][(word >> 16) & 0xff]++;
+    counts[3][(word >> 24) & 0xff]++;
+    counts[0][(word >> 32) & 0xff]++;
+    counts[1][(word >> 40) & 0xff]++;
+    counts[2][(word >> 48) & 0xff]++;
+    counts[3][word >> 56]++;
+  }
+  while (size--) {
+    counts[0][*data++]++;
+  }
+}
+
+#ifdef CPU_X86
+__attribute__((target("sse4.2")))
+static void count_symbol_frequency_sse4(uint64_t hist[], const uint8_t *data,
+                                        uint64_t size) {
+  uint32_t counts[HISTOGRAM_TABLES][MAX_SYMBOLS];
+  size_t i;
+  while (size) {
+    uint64_t chunk = size < HISTOGRAM_CHUNK ? size : HISTOGRAM_CHUNK;
+    memset(counts, 0, sizeof(counts));
+    count_symbol_frequency_x4(counts, data, chunk);
+    for (i = 0; i < MAX_SYMBOLS; i++) {
+      hist[i] += counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+    }
+    data += chunk;
+    size -= chunk;
+  }
+}
+
+__attribute__((target("avx2")))
+static void count_symbol_frequency_avx2(uint64_t hist[], const uint8_t *data,
+                                        uint64_t size) {
+  uint32_t counts[HISTOGRAM_TABLES][MAX_SYMBOLS];
+  size_t i;
+  while (size) {
+    uint64_t chunk = size < HISTOGRAM_CHUNK ? size : HISTOGRAM_CHUNK;
+    memset(counts, 0, sizeof(counts));
+    count_symbol_frequency_x4(counts, data, chunk);
+    for (i = 0; i < MAX_SYMBOLS; i += 4) {
+      __m128i sum = _mm_add_epi32(
+          _mm_add_epi32(_mm_loadu_si128((__m128i *)&counts[0][i]),
+                        _mm_loadu_si128((__m128i *)&counts[1][i])),
+          _mm_add_epi32(_mm_loadu_si128((__m128i *)&counts[2][i]),
+                        _mm_loadu_si128((__m128i *)&counts[3][i])));
+      __m256i total = _mm256_add_epi64(_mm256_loadu_si256((__m256i *)&hist[i]),
+                                       _mm256_cvtepu32_epi64(sum));
+      _mm256_storeu_si256((__m256i *)&hist[i], total);
+    }
+    data += chunk;
+    size -= chunk;
+  }
+}
+#endif
+
+void count_symbol_frequency(uint64_t hist[], const uint8_t *data, uint64_t size) {
+  switch (cpu_path()) {
+#ifdef CPU_X86
+    case CPU_PATH_BMI2:
+    case CPU_PATH_AVX2:
+      count_symbol_frequency_avx2(hist, data, size);
+      break;
+    case CPU_PATH_SSE4:
+      count_symbol_frequency_sse4(hist, data, size);
+      break;
+#endif
+    default:
+      count_symbol_frequency_scalar(hist, data, size);
+      break;
+  }
+}
+
+int64_t clalculate_symbol_frequancy(huff_node *hnf[], buffer_t *buff,
+                                    progress_t *progress) {
   uint64_t file_size = 0;
+  uint64_t hist[MAX_SYMBOLS] = {0};
   size_t i;
-  uint8_t *ch;
   while (NULL != BUFFER_READ(buff)) {
-    ch = buff->buffer;
     file_size += buff->buffer_size;
-    for (i = buff->buffer_size; --i; ch++) {
-      hnf[*ch]->frequency++;
-    }
+    count_symbol_frequency(hist, buff->buffer, buff->buffer_size);
+    PROGRESS_UPDATE(progress, buff->buffer_size);
+  }
+  for (i = 0; i < MAX_SYMBOLS; i++) {
+    hnf[i]->frequency += hist[i];
   }
   return file_size;
 _err:
@@ -75,7 +226,7 @@ int32_t cmp_huff_nodes(const void *p1, const void *p2) {
 		return -1;
   }
 
-	return (hn2->frequency - hn1->frequency);
+	return (hn2->frequency > hn1->frequency) - (hn2->frequency < hn1->frequency);
 }
 
 int32_t construct_tree(huff_node *hnf[]) {
@@ -102,9 +253,8 @@ int32_t construct_tree(huff_node *hnf[]) {
 }
 
 
-int32_t write_tree(huff_node *hn, buffer_t *buff_out, huff_code **hnct) {
-  static huff_code code_bst = { 0, 0 };
-
+static int32_t write_tree_code(huff_node *hn, buffer_t *buff_out, huff_code **hnct,
+                               huff_code *code_bst) {
   if (!hn) {
     BUFFER_BIT_APPEND_0(buff_out);
   } else if (hn->is_leaf) {
@@ -112,19 +262,19 @@ int32_t write_tree(huff_node *hn, buffer_t *buff_out, huff_code **hnct) {
     BUFFER_BIT_APPEND_0(buff_out);
 
     BUFFER_APPEND_CHAR(buff_out, hn->symbol);
-    hnct[hn->symbol] = new_huff_code(code_bst);
+    hnct[hn->symbol] = new_huff_code(*code_bst);
   } else {
-    HUFF_CODE_APPEND_ZERO(code_bst);
+    HUFF_CODE_APPEND_ZERO((*code_bst));
 
     BUFFER_BIT_APPEND_1(buff_out);
-    write_tree(hn->left, buff_out, hnct);
+    write_tree_code(hn->left, buff_out, hnct, code_bst);
 
-    HUFF_CODE_LAS_BIT_TO_ONE(code_bst);
+    HUFF_CODE_LAS_BIT_TO_ONE((*code_bst));
 
     BUFFER_BIT_APPEND_1(buff_out);
-    write_tree(hn->right, buff_out, hnct);
+    write_tree_code(hn->right, buff_out, hnct, code_bst);
 
-    HUFF_CODE_RM_LAS_BIT(code_bst);
+    HUFF_CODE_RM_LAS_BIT((*code_bst));
   }
   return 0;
 _err:
@@ -133,18 +283,35 @@ _err:
 }
 
 
+int32_t write_tree(huff_node *hn, buffer_t *buff_out, huff_code **hnct) {
+  huff_code code_bst = { 0, 0 };
+  return write_tree_code(hn, buff_out, hnct, &code_bst);
+}
 
-int32_t read_tree(huff_node **hn, buffer_t *buff_in) {
+
+
+static int32_t read_tree_depth(huff_node **hn, buffer_t *buff_in, uint32_t depth) {
   *hn = new_null_huff_node();
+  if (depth >= MAX_SYMBOLS) {
+    eprintf("Corrupted tree\n");
+    return -1;
+  }
 
   if (BUFFER_BIT_NEXT_POSITION(buff_in)) {
-    read_tree(&(*hn)->left, buff_in);
+    if (read_tree_depth(&(*hn)->left, buff_in, depth + 1) < 0) {
+      return -1;
+    }
   }
   if (BUFFER_BIT_NEXT_POSITION(buff_in)) {
-    read_tree(&(*hn)->right, buff_in);
-    return 0;
+    if (!(*hn)->left) {
+      eprintf("Corrupted tree\n");
+      return -1;
+    }
+    return read_tree_depth(&(*hn)->right, buff_in, depth + 1);
   }
   uint8_t added_char = BUFFER_GET_CHAR(buff_in);
+  huff_tree_destroy((*hn)->left);
+  (*hn)->left = NULL;
   *hn = set_symbol_huff_node(*hn, added_char);
 
   return 0;
@@ -154,6 +321,11 @@ _err:
 }
 
 
+int32_t read_tree(huff_node **hn, buffer_t *buff_in) {
+  return read_tree_depth(hn, buff_in, 0);
+}
+
+
 int32_t read_huff_code(huff_node *tree, buffer_t *buff_in, uint8_t *ch) {
   huff_node *temp = tree;
   while (1) {
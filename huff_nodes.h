@@ -20,9 +20,13 @@
 #include "error_handler.h"
 #include "huff_codes.h"
 #include "buffer.h"
+#include "progress.h"
+#include "cpu.h"
 
 
 #define MAX_SYMBOLS 256 /// Count of maxsimumx
+#define HISTOGRAM_TABLES 4              /// Partial histograms in fast kernels
+#define HISTOGRAM_CHUNK (1U << 30)      /// Bytes counted before merge
 
  /**
   * @struct huff_node
@@ -44,16 +48,79 @@ typedef struct huff_node {
 
 uint32_t huff_nodes_init(huff_node *hnf[]);
 
+/**
+ * @brief Init nodes with frequencies from histogram
+ *
+ * @param hnf Nodes to init
+ * @param hist Count of each symbol
+ * @return 0 on success and -1 if faild
+ */
+int32_t huff_nodes_init_histogram(huff_node *hnf[], const uint64_t hist[]);
+
+/**
+ * @brief Free nodes after construct_tree
+ * @details Free tree in hnf[0] and leaves of symbols that are not in tree.
+ *
+ * @param hnf Nodes after construct_tree
+ * @param symbols_count Count of symbols returned by construct_tree
+ */
+void huff_nodes_destroy(huff_node *hnf[], uint32_t symbols_count);
+
+/**
+ * @brief Free tree
+ *
+ * @param hn Root of tree
+ */
+void huff_tree_destroy(huff_node *hn);
+
+/**
+ * @brief Calculate count of bits to encode symbols with tree
+ *
+ * @param hn Root of tree
+ * @param depth Depth of hn, 0 for root
+ * @return Sum of frequency * code length
+ */
+uint64_t huff_tree_cost(huff_node *hn, uint32_t depth);
+
+/**
+ * @brief Calculate count of bits that write_tree writes for tree
+ *
+ * @param hn Root of tree
+ * @return Size of tree in bits
+ */
+uint64_t huff_tree_size(huff_node *hn);
+
+/**
+ * @brief Calculate length of longest code of tree
+ *
+ * @param hn Root of tree
+ * @return Depth of deepest leaf
+ */
+uint32_t huff_tree_depth(huff_node *hn);
+
+/**
+ * @brief Count each symbol in memory
+ * @details Adds counts to hist, hist must be initialized. Kernel is chosen
+ * by cpu_path, fast kernels count into 4 partial histograms and merge them.
+ *
+ * @param hist Count of each symbol
+ * @param data Memory with symbols
+ * @param size Size of memory
+ */
+void count_symbol_frequency(uint64_t hist[], const uint8_t *data, uint64_t size);
+
 /**
  * @brief Calculating frequency of symbols
  * @details Read file to EOF and calculation frequency of each symbol and store and in hnt
  *
  * @param hnf store frequency of symbols
  * @param buff buffer for to read symbols
+ * @param progress Progress reporter or NULL
  *
- * @return 0 on success and 1 if faild
+ * @return Size of file on success and -1 if faild
  */
-int64_t clalculate_symbol_frequancy(huff_node *hnf[], buffer_t *buff);
+int64_t clalculate_symbol_frequancy(huff_node *hnf[], buffer_t *buff,
+                                    progress_t *progress);
 
 /**
  * @brief Compare to symbols by frequency
@@ -87,10 +154,13 @@ int32_t write_tree(huff_node *hn, buffer_t *buff_out, huff_code **hnct);
 
 /**
  * @brief Read tree from input buffer
+ * @details Trees deeper than MAX_SYMBOLS and inner nodes without left
+ * child are rejected. On failure partly read tree is stored to hn and must
+ * be freed by caller.
  *
  * @param hn Element of tree
  * @param buff_in File buffer to read tree
- * @return 0 on success and 1 if faild
+ * @return 0 on success and -1 if faild
  */
 int32_t read_tree(huff_node **hn, buffer_t *buff_in);
 
@@ -0,0 +1,406 @@
+#include "huff_parallel.h"
+
+huff_parallel* huff_parallel_init(int fildes, uint32_t workers_count,
+                                  const numa_topology *numa) {
+  huff_parallel *hp = NULL;
+  struct stat st;
+
+  if (fstat(fildes, &st) < 0 || !S_ISREG(st.st_mode)) {
+    return NULL;
+  }
+  hp = CALLOC(1, sizeof(*hp));
+  hp->file = fildes;
+  hp->size = st.st_size;
+  hp->workers_count = workers_count ? workers_count : 1;
+  hp->numa = numa;
+  pthread_mutex_init(&hp->lock, NULL);
+  pthread_cond_init(&hp->ready, NULL);
+  pthread_cond_init(&hp->free, NULL);
+  return hp;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(NULL);
+}
+
+huff_parallel* huff_parallel_destroy(huff_parallel *hp) {
+  uint32_t i;
+  if (!hp) {
+    return NULL;
+  }
+  for (i = 0; i < hp->slots_count; i++) {
+    FREE(hp->slots[i].raw);
+    if (hp->slots[i].codes) {
+      buffer_destroy(hp->slots[i].codes);
+    }
+  }
+  FREE(hp->slots);
+  pthread_cond_destroy(&hp->free);
+  pthread_cond_destroy(&hp->ready);
+  pthread_mutex_destroy(&hp->lock);
+  FREE(hp);
+  return hp;
+}
+
+static void huff_parallel_fail(huff_parallel *hp) {
+  pthread_mutex_lock(&hp->lock);
+  hp->failed = true;
+  pthread_cond_broadcast(&hp->ready);
+  pthread_cond_broadcast(&hp->free);
+  pthread_mutex_unlock(&hp->lock);
+}
+
+static void huff_parallel_split(huff_parallel *hp, uint64_t piece_size) {
+  hp->piece_size = piece_size;
+  hp->pieces_count = (hp->size + piece_size - 1) / piece_size;
+  hp->next = 0;
+}
+
+/*
+ * Read piece index of input to raw, return its size.
+ */
+static int64_t huff_parallel_read(huff_parallel *hp, uint64_t index,
+                                  uint8_t *raw) {
+  uint64_t offset = index * hp->piece_size;
+  uint64_t size = hp->size - offset < hp->piece_size ?
+                  hp->size - offset : hp->piece_size;
+  uint64_t done = 0;
+  while (done < size) {
+    ssize_t readed = pread(hp->file, &raw[done], size - done, offset + done);
+    if (readed < 0) {
+      eprintf("Cannot read from file\n");
+      ERROR_GOTO();
+    }
+    if (!readed) {
+      eprintf("Input file was truncated\n");
+      ERROR_GOTO();
+    }
+    done += readed;
+  }
+  return size;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Start workers of phase. Workers wait until all are started, so work of
+ * pinned workers is split by count of workers that really run.
+ */
+static uint32_t huff_parallel_run(huff_parallel *hp, pthread_t workers[],
+                                  void *(*worker)(void *)) {
+  uint32_t started;
+  hp->ids = 0;
+  hp->active = 0;
+  for (started = 0; started < hp->workers_count; started++) {
+    if (pthread_create(&workers[started], NULL, worker, hp)) {
+      eprintf("Cannot start worker\n");
+      break;
+    }
+  }
+  pthread_mutex_lock(&hp->lock);
+  hp->active = started ? started : 1;
+  pthread_cond_broadcast(&hp->free);
+  pthread_mutex_unlock(&hp->lock);
+  return started;
+}
+
+/*
+ * Take number of worker, pin it and wait for start of phase.
+ */
+static uint32_t huff_parallel_worker_start(huff_parallel *hp) {
+  uint32_t id;
+  pthread_mutex_lock(&hp->lock);
+  id = hp->ids++;
+  pthread_mutex_unlock(&hp->lock);
+  if (hp->numa) {
+    numa_bind_worker(hp->numa, id, hp->workers_count);
+  }
+  pthread_mutex_lock(&hp->lock);
+  while (!hp->active) {
+    pthread_cond_wait(&hp->free, &hp->lock);
+  }
+  pthread_mutex_unlock(&hp->lock);
+  return id;
+}
+
+/*
+ * Take next piece to count. Pinned worker counts own contiguous range,
+ * so ranges of workers of one node are neighbours.
+ */
+static uint64_t huff_parallel_take(huff_parallel *hp, uint64_t *own,
+                                   uint64_t own_end) {
+  uint64_t index = hp->pieces_count;
+  pthread_mutex_lock(&hp->lock);
+  if (!hp->failed && hp->numa) {
+    index = *own < own_end ? (*own)++ : hp->pieces_count;
+  } else if (!hp->failed && hp->next < hp->pieces_count) {
+    index = hp->next++;
+  }
+  pthread_mutex_unlock(&hp->lock);
+  return index;
+}
+
+static void* huff_parallel_histogram_worker(void *arg) {
+  huff_parallel *hp = arg;
+  uint64_t hist[MAX_SYMBOLS] = {0};
+  uint8_t *raw = NULL;
+  uint64_t index;
+  uint32_t i;
+
+  uint32_t id = huff_parallel_worker_start(hp);
+  uint64_t own = id * hp->pieces_count / hp->active;
+  uint64_t own_end = (id + 1) * hp->pieces_count / hp->active;
+  raw = MALLOC(hp->piece_size);
+  while ((index = huff_parallel_take(hp, &own, own_end)) < hp->pieces_count) {
+    int64_t size = huff_parallel_read(hp, index, raw);
+    if (size < 0) {
+      ERROR_GOTO();
+    }
+    count_symbol_frequency(hist, raw, size);
+  }
+
+  pthread_mutex_lock(&hp->lock);
+  for (i = 0; i < MAX_SYMBOLS; i++) {
+    hp->hist[i] += hist[i];
+  }
+  pthread_mutex_unlock(&hp->lock);
+  FREE(raw);
+  return NULL;
+_err:
+  ERROR_MSG();
+  FREE(raw);
+  huff_parallel_fail(hp);
+  return NULL;
+}
+
+int64_t huff_parallel_histogram(huff_parallel *hp, huff_node *hnf[],
+                                progress_t *progress) {
+  pthread_t *workers = NULL;
+  uint32_t started;
+  uint32_t i;
+
+  huff_parallel_split(hp, HUFF_PARALLEL_PIECE_SIZE);
+  memset(hp->hist, 0, sizeof(hp->hist));
+  posix_fadvise(hp->file, 0, 0, POSIX_FADV_SEQUENTIAL);
+  workers = CALLOC(hp->workers_count, sizeof(*workers));
+  started = huff_parallel_run(hp, workers, huff_parallel_histogram_worker);
+  if (!started) {
+    hp->numa = NULL;
+    huff_parallel_histogram_worker(hp);
+  }
+  for (i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  FREE(workers);
+  if (hp->failed) {
+    ERROR_GOTO();
+  }
+
+  for (i = 0; i < MAX_SYMBOLS; i++) {
+    hnf[i]->frequency += hp->hist[i];
+  }
+  PROGRESS_UPDATE(progress, hp->size);
+  return hp->size;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int32_t huff_parallel_slot_alloc(huff_parallel *hp, huff_piece *slot) {
+  slot->raw = MALLOC(hp->piece_size);
+  slot->codes = buffer_init_memory(hp->codes_size);
+  if (!slot->codes) {
+    ERROR_GOTO();
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Encode piece of slot to its private codes buffer. Slots of pinned
+ * workers are allocated on first use by worker.
+ */
+static int32_t huff_parallel_encode_piece(huff_parallel *hp,
+                                          huff_piece *slot) {
+  if (!slot->codes && huff_parallel_slot_alloc(hp, slot) < 0) {
+    ERROR_GOTO();
+  }
+  int64_t size = huff_parallel_read(hp, slot->index, slot->raw);
+  if (size < 0) {
+    ERROR_GOTO();
+  }
+  slot->size = size;
+  BUFFER_RESET(slot->codes);
+  if (huff_codes_append(hp->hnc, hp->pairs, slot->raw, size,
+                        slot->codes) < 0) {
+    ERROR_GOTO();
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static void* huff_parallel_codes_worker(void *arg) {
+  huff_parallel *hp = arg;
+  huff_piece *slot;
+
+  /* Pinned worker encodes every active-th piece, so it reuses own slots. */
+  uint64_t own = huff_parallel_worker_start(hp);
+  pthread_mutex_lock(&hp->lock);
+  while (!hp->failed) {
+    uint64_t index = hp->numa ? own : hp->next;
+    if (index >= hp->pieces_count) {
+      break;
+    }
+    slot = &hp->slots[index % hp->slots_count];
+    if (slot->state != HUFF_PIECE_FREE) {
+      pthread_cond_wait(&hp->free, &hp->lock);
+      continue;
+    }
+    slot->state = HUFF_PIECE_BUSY;
+    slot->index = index;
+    if (hp->numa) {
+      own += hp->active;
+    } else {
+      hp->next++;
+    }
+    pthread_mutex_unlock(&hp->lock);
+
+    int32_t ret = huff_parallel_encode_piece(hp, slot);
+
+    pthread_mutex_lock(&hp->lock);
+    if (ret < 0) {
+      hp->failed = true;
+      pthread_cond_broadcast(&hp->free);
+    }
+    slot->state = HUFF_PIECE_READY;
+    pthread_cond_broadcast(&hp->ready);
+  }
+  pthread_mutex_unlock(&hp->lock);
+  return NULL;
+}
+
+/*
+ * Append codes of piece to buff_out. Each full chunk is split at bit
+ * position of output: its high bits end current output chunk and its low
+ * bits start next one. Last partial chunk is appended as bits.
+ */
+static int32_t huff_parallel_stitch(buffer_t *buff_out, buffer_t *codes) {
+  uint64_t i;
+  for (i = 0; i < codes->buffer_position; i++) {
+    uint64_t chunk = be64toh(codes->buffer64[i]);
+    uint64_t *out = &buff_out->buffer64[buff_out->buffer_position];
+    uint32_t used = buff_out->bit_position;
+    *out = used ? (*out << (UINT64_BIT - used)) | (chunk >> used) : chunk;
+    BUFFER_NEXT_W_CHUNK(buff_out);
+    if (used) {
+      buff_out->buffer64[buff_out->buffer_position] = chunk;
+      buff_out->bit_position = used;
+    }
+  }
+  if (codes->bit_position) {
+    uint32_t numbits = codes->bit_position;
+    uint64_t bits = codes->buffer64[codes->buffer_position] &
+                    ((1ULL << numbits) - 1);
+    BUFFER_APPEND_BITS(buff_out, bits, numbits);
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Choose piece size so codes of piece fit HUFF_PARALLEL_CODES_SIZE even
+ * if every symbol takes longest code, and allocate slots.
+ */
+static int32_t huff_parallel_slots_init(huff_parallel *hp, huff_code *hnct[]) {
+  uint64_t piece_size = HUFF_PARALLEL_PIECE_SIZE;
+  uint32_t max_bits = 1;
+  uint32_t i;
+
+  for (i = 0; i < MAX_SYMBOLS; i++) {
+    if (hnct[i] && hnct[i]->numbits > max_bits) {
+      max_bits = hnct[i]->numbits;
+    }
+  }
+  if (piece_size > HUFF_PARALLEL_CODES_SIZE * CHAR_BIT / max_bits) {
+    piece_size = HUFF_PARALLEL_CODES_SIZE * CHAR_BIT / max_bits;
+    piece_size -= piece_size % sizeof(uint64_t);
+  }
+  huff_parallel_split(hp, piece_size);
+  hp->codes_size = piece_size * max_bits / CHAR_BIT + 2 * sizeof(uint64_t);
+
+  hp->slots_count = hp->workers_count * HUFF_PARALLEL_SLOTS_PER_WORKER;
+  hp->slots = CALLOC(hp->slots_count, sizeof(*hp->slots));
+  for (i = 0; !hp->numa && i < hp->slots_count; i++) {
+    if (huff_parallel_slot_alloc(hp, &hp->slots[i]) < 0) {
+      ERROR_GOTO();
+    }
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+int32_t huff_parallel_codes(huff_parallel *hp, huff_code *hnct[],
+                            const huff_pair_table *pairs, buffer_t *buff_out,
+                            progress_t *progress) {
+  pthread_t *workers = NULL;
+  uint32_t started = 0;
+  uint64_t index;
+  uint32_t i;
+
+  hp->hnc = hnct;
+  hp->pairs = pairs;
+  if (huff_parallel_slots_init(hp, hnct) < 0) {
+    ERROR_GOTO();
+  }
+  workers = CALLOC(hp->workers_count, sizeof(*workers));
+  started = huff_parallel_run(hp, workers, huff_parallel_codes_worker);
+  if (!started) {
+    ERROR_GOTO();
+  }
+
+  for (index = 0; index < hp->pieces_count; index++) {
+    huff_piece *slot = &hp->slots[index % hp->slots_count];
+    pthread_mutex_lock(&hp->lock);
+    while (!hp->failed && !(slot->state == HUFF_PIECE_READY &&
+                            slot->index == index)) {
+      pthread_cond_wait(&hp->ready, &hp->lock);
+    }
+    pthread_mutex_unlock(&hp->lock);
+    if (hp->failed) {
+      ERROR_GOTO();
+    }
+
+    if (huff_parallel_stitch(buff_out, slot->codes) < 0) {
+      huff_parallel_fail(hp);
+      ERROR_GOTO();
+    }
+    PROGRESS_UPDATE(progress, slot->size);
+
+    pthread_mutex_lock(&hp->lock);
+    slot->state = HUFF_PIECE_FREE;
+    pthread_cond_broadcast(&hp->free);
+    pthread_mutex_unlock(&hp->lock);
+  }
+
+  for (i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  FREE(workers);
+  return 0;
+_err:
+  ERROR_MSG();
+  huff_parallel_fail(hp);
+  for (i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  FREE(workers);
+  ERROR_RETURN(-1);
+}
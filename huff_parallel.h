@@ -0,0 +1,135 @@
+/**
+ * @file       huff_parallel.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for parallel encoding of legacy format.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef HUFF_PARALLEL_H_
+#define HUFF_PARALLEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "error_handler.h"
+#include "macros.h"
+#include "buffer.h"
+#include "huff_codes.h"
+#include "huff_nodes.h"
+#include "progress.h"
+#include "numa.h"
+
+
+#define HUFF_PARALLEL_PIECE_SIZE (1024*1024*4)  /// Input bytes per task
+#define HUFF_PARALLEL_CODES_SIZE (1024*1024*4)  /// Largest codes of task
+#define HUFF_PARALLEL_SLOTS_PER_WORKER 2        /// Tasks ahead of stitching
+
+typedef enum {
+  HUFF_PIECE_FREE,                  /**< Slot can take next piece */
+  HUFF_PIECE_BUSY,                  /**< Worker encodes piece */
+  HUFF_PIECE_READY,                 /**< Codes wait for stitching */
+} huff_piece_state_t;
+
+ /**
+  * @struct huff_piece
+  * @brief This struct store one piece of input and its codes
+  */
+typedef struct huff_piece {
+  huff_piece_state_t state;         /**< Who owns slot */
+  uint64_t index;                   /**< Number of piece in input */
+  uint64_t size;                    /**< Input bytes of piece */
+  uint8_t  *raw;                    /**< Input of piece */
+  buffer_t *codes;                  /**< Codes, chunks before position are
+                                         big endian, last is partial */
+} huff_piece;
+
+ /**
+  * @struct huff_parallel
+  * @brief This struct store state of parallel encoder
+  * @details Input is split into pieces that workers take in order. Codes
+  * of each piece are written to private memory buffer and stitched to
+  * output at any bit offset, so output equals output of serial encoder.
+  */
+typedef struct huff_parallel {
+  int      file;                    /**< Input file */
+  uint64_t size;                    /**< Size of input */
+  uint32_t workers_count;           /**< Threads of each phase */
+  const numa_topology *numa;        /**< Pin workers by node or NULL */
+  uint32_t ids;                     /**< Numbers given to started workers */
+  uint32_t active;                  /**< Workers of phase, 0 until started */
+  uint64_t piece_size;              /**< Input bytes per piece */
+  uint64_t pieces_count;            /**< Pieces of input */
+  uint64_t next;                    /**< First piece not taken */
+  uint64_t hist[MAX_SYMBOLS];       /**< Histogram of input */
+  huff_code **hnc;                  /**< Codes table of tree */
+  const huff_pair_table *pairs;     /**< Codes of symbol pairs or NULL */
+  uint64_t codes_size;              /**< Capacity of codes of piece */
+  huff_piece *slots;                /**< Pieces in flight */
+  uint32_t slots_count;             /**< Size of slots */
+  bool     failed;                  /**< Some worker failed */
+  pthread_mutex_t lock;             /**< Guard of next, slots and failed */
+  pthread_cond_t ready;             /**< Signaled when piece is encoded */
+  pthread_cond_t free;              /**< Signaled when piece is stitched and
+                                         when workers are started */
+} huff_parallel;
+
+/**
+ * @brief Create parallel encoder of file
+ * @details Works only on regular files, because workers read pieces at
+ * their offsets. With numa each worker is pinned to CPU, counts own
+ * contiguous range of pieces and encodes every active-th piece in slots
+ * it allocates itself, so their memory is on its node.
+ *
+ * @param fildes Input file
+ * @param workers_count Threads of each phase
+ * @param numa Topology to pin workers or NULL
+ * @return Pointer to encoder or NULL if input is not regular file or failed
+ */
+huff_parallel* huff_parallel_init(int fildes, uint32_t workers_count,
+                                  const numa_topology *numa);
+
+/**
+ * @brief Free parallel encoder
+ *
+ * @param hp Encoder or NULL
+ * @return NULL
+ */
+huff_parallel* huff_parallel_destroy(huff_parallel *hp);
+
+/**
+ * @brief Calculating frequency of symbols with workers
+ * @details Each worker counts own histogram of pieces, histograms are
+ * summed at the end. Same as clalculate_symbol_frequancy.
+ *
+ * @param hp Encoder
+ * @param hnf store frequency of symbols
+ * @param progress Progress reporter or NULL
+ * @return Size of file on success and -1 if faild
+ */
+int64_t huff_parallel_histogram(huff_parallel *hp, huff_node *hnf[],
+                                progress_t *progress);
+
+/**
+ * @brief Append codes of input to output buffer with workers
+ * @details Workers encode pieces, caller thread stitches them to buff_out
+ * in order with shift and merge of 64 bit chunks.
+ *
+ * @param hp Encoder
+ * @param hnct Huffman codes table
+ * @param pairs Table of pairs of hnct or NULL
+ * @param buff_out Output buffer after tree
+ * @param progress Progress reporter or NULL
+ * @return 0 on success and -1 if faild
+ */
+int32_t huff_parallel_codes(huff_parallel *hp, huff_code *hnct[],
+                            const huff_pair_table *pairs, buffer_t *buff_out,
+                            progress_t *progress);
+
+#endif /* HUFF_PARALLEL_H_ */
@@ -0,0 +1,256 @@
+#include "huff_stream.h"
+
+#define HUFF_STREAM_AVAILABLE(hs)                                              \
+      ((hs)->input->buffer_size - (hs)->input->buffer_position)
+
+huff_stream* huff_stream_init() {
+  huff_stream *hs = CALLOC(1, sizeof(*hs));
+  hs->input = buffer_init_memory(BUFF_MIN_SIZE);
+  if (!hs->input) {
+    ERROR_GOTO();
+  }
+  hs->state = HUFF_STREAM_HEADER;
+  return hs;
+_err:
+  ERROR_MSG();
+  FREE(hs);
+  ERROR_RETURN(NULL);
+}
+
+huff_stream* huff_stream_destroy(huff_stream *hs) {
+  huff_table_destroy(hs->table);
+  huff_tree_destroy(hs->tree);
+  block_decoder_clear(&hs->decoder);
+  if (hs->input) {
+    buffer_destroy(hs->input);
+  }
+  if (hs->payload) {
+    buffer_destroy(hs->payload);
+  }
+  if (hs->raw) {
+    buffer_destroy(hs->raw);
+  }
+  FREE(hs);
+  return hs;
+}
+
+int32_t huff_stream_feed(huff_stream *hs, const uint8_t *data, uint64_t size) {
+  buffer_t *in = hs->input;
+  uint64_t rest = HUFF_STREAM_AVAILABLE(hs);
+
+  if (hs->input_finished) {
+    eprintf("Input is already finished\n");
+    return -1;
+  }
+  if (!size) {
+    hs->input_finished = true;
+    return 0;
+  }
+
+  memmove(in->buffer, &in->buffer[in->buffer_position], rest);
+  in->buffer_position = 0;
+  in->buffer_size = rest;
+  if (rest + size > in->buffer_capacity) {
+    uint64_t capacity = in->buffer_capacity * 2;
+    if (capacity < rest + size) {
+      capacity = rest + size;
+    }
+    uint8_t *grown = realloc(in->buffer, capacity + BUFF_SLACK_SIZE);
+    if (!grown) {
+      ERROR_GOTO();
+    }
+    in->buffer = grown;
+    in->buffer_capacity = capacity;
+  }
+  memcpy(&in->buffer[rest], data, size);
+  in->buffer_size += size;
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Count of symbols that can be decoded without reaching end of fed input.
+ * Every symbol takes at most max_bits, margin keeps refill in buffer.
+ */
+static uint64_t huff_stream_safe_symbols(huff_stream *hs) {
+  if (hs->input_finished) {
+    return hs->left;
+  }
+  uint64_t bits = HUFF_STREAM_AVAILABLE(hs) * CHAR_BIT + hs->input->bit_count;
+  if (bits <= HUFF_STREAM_MARGIN_BITS) {
+    return 0;
+  }
+  uint64_t count = (bits - HUFF_STREAM_MARGIN_BITS) / hs->max_bits;
+  return count < hs->left ? count : hs->left;
+}
+
+static int32_t huff_stream_start_codes(huff_stream *hs) {
+  hs->input->bit_position = CHAR_BIT;
+  if (read_tree(&hs->tree, hs->input) < 0) {
+    ERROR_GOTO();
+  }
+  hs->max_bits = huff_tree_depth(hs->tree);
+  if (!hs->max_bits) {
+    hs->max_bits = 1;
+  }
+  hs->table = huff_table_init(hs->tree, huff_table_choose_symbols(hs->tree));
+  if (!hs->table) {
+    ERROR_GOTO();
+  }
+  BUFFER_BITS_INIT(hs->input);
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int32_t huff_stream_read_block(huff_stream *hs) {
+  block_header *header = &hs->header;
+  hs->payload = block_reserve(hs->payload, header->payload_size);
+  hs->raw = block_reserve(hs->raw, header->raw_size);
+  if (!hs->payload || !hs->raw) {
+    ERROR_GOTO();
+  }
+  memcpy(hs->payload->buffer, &hs->input->buffer[hs->input->buffer_position],
+         header->payload_size);
+  hs->payload->buffer_size = header->payload_size;
+  hs->input->buffer_position += header->payload_size;
+  if (block_decode_one(header, hs->payload, hs->raw->buffer,
+                       &hs->decoder) < 0) {
+    ERROR_GOTO();
+  }
+  hs->raw_position = 0;
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+int64_t huff_stream_decode_some(huff_stream *hs, uint8_t *out,
+                                uint64_t out_capacity) {
+  buffer_t *in = hs->input;
+  uint64_t produced = 0;
+  uint64_t count;
+  uint64_t value;
+
+  while (produced < out_capacity) {
+    switch (hs->state) {
+      case HUFF_STREAM_HEADER:
+        if (HUFF_STREAM_AVAILABLE(hs) < sizeof(value)) {
+          if (hs->input_finished) {
+            eprintf("Truncated input\n");
+            ERROR_GOTO();
+          }
+          return produced;
+        }
+        memcpy(&value, &in->buffer[in->buffer_position], sizeof(value));
+        in->buffer_position += sizeof(value);
+        value = le64toh(value);
+        if (value == BLOCK_MAGIC) {
+          hs->state = HUFF_STREAM_BLOCK_HEADER;
+        } else {
+          hs->left = value;
+          hs->state = HUFF_STREAM_TREE;
+        }
+        break;
+
+      case HUFF_STREAM_TREE:
+        if (HUFF_STREAM_AVAILABLE(hs) < HUFF_STREAM_TREE_BYTES &&
+            !hs->input_finished) {
+          return produced;
+        }
+        if (huff_stream_start_codes(hs) < 0) {
+          ERROR_GOTO();
+        }
+        hs->state = HUFF_STREAM_CODES;
+        break;
+
+      case HUFF_STREAM_CODES:
+        if (!hs->left) {
+          hs->state = HUFF_STREAM_DONE;
+          break;
+        }
+        count = huff_stream_safe_symbols(hs);
+        if (count > out_capacity - produced) {
+          count = out_capacity - produced;
+        }
+        if (!count) {
+          return produced;
+        }
+        if (huff_table_decode(hs->table, in, &out[produced], count) < 0) {
+          ERROR_GOTO();
+        }
+        produced += count;
+        hs->left -= count;
+        if (!hs->left) {
+          hs->state = HUFF_STREAM_DONE;
+        }
+        break;
+
+      case HUFF_STREAM_BLOCK_HEADER:
+        if (HUFF_STREAM_AVAILABLE(hs) < BLOCK_HEADER_SIZE) {
+          if (!hs->input_finished) {
+            return produced;
+          }
+          if (HUFF_STREAM_AVAILABLE(hs)) {
+            eprintf("Truncated block header\n");
+            ERROR_GOTO();
+          }
+          hs->state = HUFF_STREAM_DONE;
+          break;
+        }
+        BLOCK_HEADER_PARSE(hs->header, &in->buffer[in->buffer_position]);
+        in->buffer_position += BLOCK_HEADER_SIZE;
+        if (hs->header.flags & ~BLOCK_FLAGS_KNOWN) {
+          eprintf("Corrupted block header\n");
+          ERROR_GOTO();
+        }
+        hs->state = HUFF_STREAM_BLOCK_PAYLOAD;
+        break;
+
+      case HUFF_STREAM_BLOCK_PAYLOAD:
+        if (HUFF_STREAM_AVAILABLE(hs) < hs->header.payload_size) {
+          if (hs->input_finished) {
+            eprintf("Truncated block\n");
+            ERROR_GOTO();
+          }
+          return produced;
+        }
+        if (huff_stream_read_block(hs) < 0) {
+          ERROR_GOTO();
+        }
+        hs->state = HUFF_STREAM_BLOCK_OUTPUT;
+        break;
+
+      case HUFF_STREAM_BLOCK_OUTPUT:
+        count = hs->header.raw_size - hs->raw_position;
+        if (count > out_capacity - produced) {
+          count = out_capacity - produced;
+        }
+        memcpy(&out[produced], &hs->raw->buffer[hs->raw_position], count);
+        produced += count;
+        hs->raw_position += count;
+        if (hs->raw_position == hs->header.raw_size) {
+          hs->state = HUFF_STREAM_BLOCK_HEADER;
+        }
+        break;
+
+      case HUFF_STREAM_DONE:
+        return produced;
+
+      case HUFF_STREAM_ERROR:
+        ERROR_RETURN(-1);
+    }
+  }
+  return produced;
+_err:
+  ERROR_MSG();
+  hs->state = HUFF_STREAM_ERROR;
+  ERROR_RETURN(-1);
+}
+
+bool huff_stream_done(const huff_stream *hs) {
+  return hs->state == HUFF_STREAM_DONE;
+}
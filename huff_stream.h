@@ -0,0 +1,109 @@
+/**
+ * @file       huff_stream.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for incremental decoding from memory.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef HUFF_STREAM_H_
+#define HUFF_STREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "error_handler.h"
+#include "macros.h"
+#include "buffer.h"
+#include "huff_nodes.h"
+#include "huff_table.h"
+#include "block.h"
+
+
+#define HUFF_STREAM_TREE_BYTES 400          /// Largest serialized tree
+#define HUFF_STREAM_MARGIN_BITS 128         /// Input kept for refill
+
+typedef enum {
+  HUFF_STREAM_HEADER,               /**< Waiting for size or magic */
+  HUFF_STREAM_TREE,                 /**< Waiting for tree */
+  HUFF_STREAM_CODES,                /**< Decoding huffman codes */
+  HUFF_STREAM_BLOCK_HEADER,         /**< Waiting for block header */
+  HUFF_STREAM_BLOCK_PAYLOAD,        /**< Waiting for whole block */
+  HUFF_STREAM_BLOCK_OUTPUT,         /**< Giving decoded block */
+  HUFF_STREAM_DONE,                 /**< All data decoded */
+  HUFF_STREAM_ERROR,                /**< Input is corrupted */
+} huff_stream_state_t;
+
+ /**
+  * @struct huff_stream
+  * @brief This struct store state of incremental decoder
+  * @details Input fragments are appended to memory buffer, consumed bytes
+  * are dropped on next feed. Bit container of input buffer and decode
+  * table live between calls.
+  */
+typedef struct huff_stream {
+  huff_stream_state_t state;        /**< What decoder waits for */
+  buffer_t *input;                  /**< Not consumed input */
+  bool input_finished;              /**< No more fragments will come */
+  uint64_t left;                    /**< Symbols left in legacy stream */
+  huff_node *tree;                  /**< Tree of legacy stream */
+  huff_table *table;                /**< Decode table of legacy stream */
+  uint32_t max_bits;                /**< Longest code of tree */
+  block_header header;              /**< Header of current block */
+  buffer_t *payload;                /**< Payload of current block */
+  buffer_t *raw;                    /**< Decoded current block */
+  uint64_t raw_position;            /**< Bytes of block already given */
+  block_decoder decoder;            /**< Memory reused between blocks */
+} huff_stream;
+
+/**
+ * @brief Create decoder
+ * @return Pointer to new decoder or NULL if failed
+ */
+huff_stream* huff_stream_init();
+
+/**
+ * @brief Free decoder
+ *
+ * @param hs Decoder
+ * @return NULL
+ */
+huff_stream* huff_stream_destroy(huff_stream *hs);
+
+/**
+ * @brief Append fragment of encoded input
+ * @details Fragment is copied, it can be of any size. Input of legacy
+ * files and block archives is accepted.
+ *
+ * @param hs Decoder
+ * @param data Fragment
+ * @param size Size of fragment, 0 marks end of input
+ * @return 0 on success and -1 if faild
+ */
+int32_t huff_stream_feed(huff_stream *hs, const uint8_t *data, uint64_t size);
+
+/**
+ * @brief Decode up to out_capacity bytes
+ * @details Decodes as much as fed input allows. 0 is returned when more
+ * input is needed or all data is decoded, check huff_stream_done.
+ *
+ * @param hs Decoder
+ * @param out Memory for decoded bytes
+ * @param out_capacity Size of out
+ * @return Count of decoded bytes or -1 if input is corrupted
+ */
+int64_t huff_stream_decode_some(huff_stream *hs, uint8_t *out,
+                                uint64_t out_capacity);
+
+/**
+ * @brief Check that all data is decoded
+ *
+ * @param hs Decoder
+ * @return true if end of stream is reached
+ */
+bool huff_stream_done(const huff_stream *hs);
+
+#endif /* HUFF_STREAM_H_ */
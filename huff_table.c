@@ -0,0 +1,209 @@
+#include "huff_table.h"
+
+static double huff_table_average_bits(huff_node *hn, uint32_t depth) {
+  if (!hn) {
+    return 0;
+  }
+  if (hn->is_leaf) {
+    return depth < UINT64_BIT ? depth / (double)(1ULL << depth) : 0;
+  }
+  return huff_table_average_bits(hn->left, depth + 1) +
+         huff_table_average_bits(hn->right, depth + 1);
+}
+
+static int32_t huff_table_walk(huff_node *hn, buffer_t *buff_in, uint8_t *ch) {
+  while (!hn->is_leaf) {
+    if (!buff_in->bit_count) {
+      BUFFER_BITS_REFILL(buff_in);
+    }
+    uint64_t bit = BUFFER_BITS_PEEK(buff_in, 1);
+    BUFFER_BITS_SKIP(buff_in, 1);
+    hn = bit ? hn->right : hn->left;
+  }
+  *ch = hn->symbol;
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static uint64_t huff_table_tree_hash(huff_node *hn, uint64_t hash) {
+  hash = (hash ^ (hn ? hn->is_leaf + 1 : 0)) * 0x100000001b3ULL;
+  if (!hn) {
+    return hash;
+  }
+  if (hn->is_leaf) {
+    return (hash ^ hn->symbol) * 0x100000001b3ULL;
+  }
+  hash = huff_table_tree_hash(hn->left, hash);
+  return huff_table_tree_hash(hn->right, hash);
+}
+
+static bool huff_table_tree_equal(huff_node *a, huff_node *b) {
+  if (!a || !b) {
+    return a == b;
+  }
+  if (a->is_leaf || b->is_leaf) {
+    return a->is_leaf == b->is_leaf && a->symbol == b->symbol;
+  }
+  return huff_table_tree_equal(a->left, b->left) &&
+         huff_table_tree_equal(a->right, b->right);
+}
+
+uint32_t huff_table_choose_symbols(huff_node *tree) {
+  double average = huff_table_average_bits(tree, 0);
+  if (average > 0 && average * 2 <= HUFF_TABLE_BITS) {
+    return HUFF_TABLE_MAX_SYMBOLS;
+  }
+  return 1;
+}
+
+huff_table* huff_table_init(huff_node *tree, uint32_t max_symbols) {
+  huff_table *table = CALLOC(1, sizeof(*table));
+  uint32_t subtrees_count = 0;
+  uint32_t idx;
+
+  table->tree = tree;
+  table->max_symbols = max_symbols;
+  if (tree->is_leaf) {
+    return table;
+  }
+
+  for (idx = 0; idx < HUFF_TABLE_SIZE; idx++) {
+    huff_table_entry *entry = &table->entries[idx];
+    uint32_t pos = 0;
+    while (entry->count < max_symbols) {
+      huff_node *hn = tree;
+      uint32_t end = pos;
+      while (!hn->is_leaf && end < HUFF_TABLE_BITS) {
+        hn = (idx >> (HUFF_TABLE_BITS - 1 - end)) & 1 ? hn->right : hn->left;
+        end++;
+      }
+      if (!hn->is_leaf) {
+        if (!entry->count) {
+          entry->subtree = subtrees_count;
+          table->subtrees[subtrees_count++] = hn;
+          pos = HUFF_TABLE_BITS;
+        }
+        break;
+      }
+      entry->symbols[entry->count++] = hn->symbol;
+      pos = end;
+    }
+    entry->numbits = pos;
+  }
+  return table;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(NULL);
+}
+
+huff_table* huff_table_destroy(huff_table *table) {
+  FREE(table);
+  return table;
+}
+
+huff_table* huff_table_cache_get(huff_table_cache *cache, huff_node *tree) {
+  uint64_t key = huff_table_tree_hash(tree, 0xcbf29ce484222325ULL);
+  huff_table *table;
+  uint32_t i;
+
+  for (i = 0; i < HUFF_TABLE_CACHE_SIZE; i++) {
+    table = cache->tables[i];
+    if (table && cache->keys[i] == key &&
+        huff_table_tree_equal(table->tree, tree)) {
+      huff_tree_destroy(tree);
+      cache->hits++;
+      return table;
+    }
+  }
+
+  table = huff_table_init(tree, huff_table_choose_symbols(tree));
+  if (!table) {
+    huff_tree_destroy(tree);
+    return NULL;
+  }
+  i = cache->next;
+  cache->next = (cache->next + 1) % HUFF_TABLE_CACHE_SIZE;
+  if (cache->tables[i]) {
+    huff_tree_destroy(cache->tables[i]->tree);
+    huff_table_destroy(cache->tables[i]);
+  }
+  cache->keys[i] = key;
+  cache->tables[i] = table;
+  cache->misses++;
+  return table;
+}
+
+void huff_table_cache_clear(huff_table_cache *cache) {
+  uint32_t i;
+  for (i = 0; i < HUFF_TABLE_CACHE_SIZE; i++) {
+    if (cache->tables[i]) {
+      huff_tree_destroy(cache->tables[i]->tree);
+      cache->tables[i] = huff_table_destroy(cache->tables[i]);
+    }
+  }
+}
+
+static inline __attribute__((always_inline))
+int32_t huff_table_decode_body(huff_table *table, buffer_t *buff_in,
+                               uint8_t *out, uint64_t count) {
+  if (table->tree->is_leaf) {
+    memset(out, table->tree->symbol, count);
+    return 0;
+  }
+
+  while (count >= HUFF_TABLE_MAX_SYMBOLS) {
+    BUFFER_BITS_REFILL(buff_in);
+    while (buff_in->bit_count >= HUFF_TABLE_BITS &&
+           count >= HUFF_TABLE_MAX_SYMBOLS) {
+      huff_table_entry *entry =
+              &table->entries[BUFFER_BITS_PEEK(buff_in, HUFF_TABLE_BITS)];
+      if (entry->count) {
+        memcpy(out, entry->symbols, HUFF_TABLE_MAX_SYMBOLS);
+        out += entry->count;
+        count -= entry->count;
+        BUFFER_BITS_SKIP(buff_in, entry->numbits);
+      } else {
+        BUFFER_BITS_SKIP(buff_in, HUFF_TABLE_BITS);
+        if (huff_table_walk(table->subtrees[entry->subtree], buff_in, out++) < 0) {
+          ERROR_GOTO();
+        }
+        count--;
+      }
+    }
+  }
+
+  while (count--) {
+    if (huff_table_walk(table->tree, buff_in, out++) < 0) {
+      ERROR_GOTO();
+    }
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int32_t huff_table_decode_generic(huff_table *table, buffer_t *buff_in,
+                                         uint8_t *out, uint64_t count) {
+  return huff_table_decode_body(table, buff_in, out, count);
+}
+
+#ifdef CPU_X86
+__attribute__((target("bmi2")))
+static int32_t huff_table_decode_bmi2(huff_table *table, buffer_t *buff_in,
+                                      uint8_t *out, uint64_t count) {
+  return huff_table_decode_body(table, buff_in, out, count);
+}
+#endif
+
+int32_t huff_table_decode(huff_table *table, buffer_t *buff_in,
+                          uint8_t *out, uint64_t count) {
+#ifdef CPU_X86
+  if (cpu_path() == CPU_PATH_BMI2) {
+    return huff_table_decode_bmi2(table, buff_in, out, count);
+  }
+#endif
+  return huff_table_decode_generic(table, buff_in, out, count);
+}
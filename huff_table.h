@@ -0,0 +1,128 @@
+/**
+ * @file       huff_table.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for table driven decoding.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef HUFF_TABLE_H_
+#define HUFF_TABLE_H_
+
+#include <stdint.h>
+#include "error_handler.h"
+#include "huff_nodes.h"
+#include "buffer.h"
+#include "cpu.h"
+
+
+#define HUFF_TABLE_BITS 11                  /// Width of table index
+#define HUFF_TABLE_SIZE (1 << HUFF_TABLE_BITS)
+#define HUFF_TABLE_MAX_SYMBOLS 4            /// Symbols in one table entry
+#define HUFF_TABLE_CACHE_SIZE 8             /// Tables kept by cache
+
+ /**
+  * @struct huff_table_entry
+  * @brief This struct store symbols decoded from one table index
+  */
+typedef struct huff_table_entry {
+  uint8_t  symbols[HUFF_TABLE_MAX_SYMBOLS]; /**< Decoded symbols */
+  uint8_t  count;                   /**< Count of symbols, 0 if code is long */
+  uint8_t  numbits;                 /**< Count of bits used by symbols */
+  uint16_t subtree;                 /**< Index of subtree for long code */
+} huff_table_entry;
+
+ /**
+  * @struct huff_table
+  * @brief This struct store decode table built from huffman tree
+  */
+typedef struct huff_table {
+  huff_table_entry entries[HUFF_TABLE_SIZE]; /**< Entries by next bits */
+  huff_node *subtrees[HUFF_TABLE_SIZE];      /**< Nodes for long codes */
+  huff_node *tree;                  /**< Root of huffman tree */
+  uint32_t  max_symbols;            /**< Symbols per entry, 1 or more */
+} huff_table;
+
+ /**
+  * @struct huff_table_cache
+  * @brief This struct store recently built decode tables
+  * @details Tables are found by hash of tree and checked by comparing
+  * trees. Oldest table is replaced when cache is full. Cache is not
+  * thread safe, use one cache per thread.
+  */
+typedef struct huff_table_cache {
+  uint64_t   keys[HUFF_TABLE_CACHE_SIZE];   /**< Hashes of trees */
+  huff_table *tables[HUFF_TABLE_CACHE_SIZE]; /**< Tables, own their trees */
+  uint32_t   next;                  /**< Slot to replace */
+  uint64_t   hits;                  /**< Count of reused tables */
+  uint64_t   misses;                /**< Count of built tables */
+} huff_table_cache;
+
+/**
+ * @brief Choose count of symbols per table entry
+ * @details Estimate average code length from code lengths as
+ * sum(len * 2^-len). If several average codes fit in table index then
+ * multi symbol entries are used, else one symbol per entry.
+ *
+ * @param tree Huffman tree
+ * @return Count of symbols per table entry
+ */
+uint32_t huff_table_choose_symbols(huff_node *tree);
+
+/**
+ * @brief Create decode table
+ * @details Walk tree for each value of table index and store up to
+ * max_symbols whole symbols whose codes fit in index.
+ *
+ * @param tree Huffman tree
+ * @param max_symbols Symbols per entry
+ * @return Pointer to new table or NULL if failed
+ */
+huff_table* huff_table_init(huff_node *tree, uint32_t max_symbols);
+
+/**
+ * @brief Free decode table
+ *
+ * @param table Decode table
+ * @return NULL
+ */
+huff_table* huff_table_destroy(huff_table *table);
+
+/**
+ * @brief Get decode table for tree from cache
+ * @details If same tree is in cache then tree is freed and cached table is
+ * returned, else new table is built and stored. In both cases cache owns
+ * tree after call.
+ *
+ * @param cache Table cache
+ * @param tree Huffman tree
+ * @return Pointer to table or NULL if failed
+ */
+huff_table* huff_table_cache_get(huff_table_cache *cache, huff_node *tree);
+
+/**
+ * @brief Free all tables and trees in cache
+ *
+ * @param cache Table cache
+ */
+void huff_table_cache_clear(huff_table_cache *cache);
+
+/**
+ * @brief Decode symbols from input buffer
+ * @details Input buffer must be switched to bit container with
+ * BUFFER_BITS_INIT before first call. On BMI2 path bits are extracted
+ * with shrx/bzhi.
+ *
+ * @param table Decode table
+ * @param buff_in Input buffer
+ * @param out Memory for decoded symbols
+ * @param count Count of symbols to decode
+ * @return 0 on success and -1 if faild
+ */
+int32_t huff_table_decode(huff_table *table, buffer_t *buff_in,
+                          uint8_t *out, uint64_t count);
+
+#endif /* HUFF_TABLE_H_ */
@@ -0,0 +1,340 @@
+#include "huff_wide.h"
+
+static int cmp_wide_keys(const void *a, const void *b) {
+  uint64_t ka = *(const uint64_t *)a;
+  uint64_t kb = *(const uint64_t *)b;
+  return (ka > kb) - (ka < kb);
+}
+
+static uint32_t huff_wide_varint_size(uint32_t value) {
+  uint32_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+/*
+ * Moffat and Katajainen in-place code lengths. Weights must be sorted
+ * ascending, on return they are replaced by code lengths.
+ */
+static void huff_wide_lengths(uint32_t w[], int32_t n) {
+  int32_t root, leaf, next, avbl, used, depth;
+  if (n == 1) {
+    w[0] = 1;
+    return;
+  }
+  w[0] += w[1];
+  root = 0;
+  leaf = 2;
+  for (next = 1; next < n - 1; next++) {
+    if (leaf >= n || w[root] < w[leaf]) {
+      w[next] = w[root];
+      w[root++] = next;
+    } else {
+      w[next] = w[leaf++];
+    }
+    if (leaf >= n || (root < next && w[root] < w[leaf])) {
+      w[next] += w[root];
+      w[root++] = next;
+    } else {
+      w[next] += w[leaf++];
+    }
+  }
+  w[n - 2] = 0;
+  for (next = n - 3; next >= 0; next--) {
+    w[next] = w[w[next]] + 1;
+  }
+  avbl = 1;
+  used = depth = 0;
+  root = n - 2;
+  next = n - 1;
+  while (avbl > 0) {
+    while (root >= 0 && (int32_t)w[root] == depth) {
+      used++;
+      root--;
+    }
+    while (avbl > used) {
+      w[next--] = depth;
+      avbl--;
+    }
+    avbl = 2 * used;
+    depth++;
+    used = 0;
+  }
+}
+
+/*
+ * Clamp lengths to WIDE_MAX_BITS, then make longest codes that are
+ * shorter than limit one bit longer until Kraft sum fits.
+ * Lengths are sorted descending.
+ */
+static void huff_wide_limit(uint32_t lengths[], uint32_t n) {
+  uint64_t kraft = 0;
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    if (lengths[i] > WIDE_MAX_BITS) {
+      lengths[i] = WIDE_MAX_BITS;
+    }
+    kraft += 1ULL << (WIDE_MAX_BITS - lengths[i]);
+  }
+  while (kraft > (1ULL << WIDE_MAX_BITS)) {
+    for (i = 0; lengths[i] >= WIDE_MAX_BITS; i++);
+    kraft -= 1ULL << (WIDE_MAX_BITS - lengths[i] - 1);
+    lengths[i]++;
+  }
+}
+
+/*
+ * Assign canonical codes. On input sorted has symbols and weights has
+ * their lengths, on return symbols are sorted by length and value.
+ */
+static int32_t huff_wide_canonical(huff_wide *hw) {
+  uint64_t kraft = 0;
+  uint32_t code = 0;
+  uint32_t i, len;
+
+  memset(hw->length_count, 0, sizeof(hw->length_count));
+  memset(hw->table, 0, sizeof(hw->table));
+  hw->max_bits = 0;
+  for (i = 0; i < hw->symbols_count; i++) {
+    len = hw->weights[i];
+    if (!len || len > WIDE_MAX_BITS) {
+      return -1;
+    }
+    kraft += 1ULL << (WIDE_MAX_BITS - len);
+    hw->keys[i] = (uint64_t)len << 16 | hw->sorted[i];
+  }
+  if (kraft > (1ULL << WIDE_MAX_BITS)) {
+    return -1;
+  }
+  qsort(hw->keys, hw->symbols_count, sizeof(*hw->keys), cmp_wide_keys);
+
+  for (i = 0; i < hw->symbols_count; i++) {
+    hw->sorted[i] = hw->keys[i] & 0xffff;
+    hw->length_count[hw->keys[i] >> 16]++;
+  }
+  for (len = 1, i = 0; len <= WIDE_MAX_BITS; len++) {
+    hw->first_code[len] = code;
+    hw->first_index[len] = i;
+    code = (code + hw->length_count[len]) << 1;
+    i += hw->length_count[len];
+    if (hw->length_count[len]) {
+      hw->max_bits = len;
+    }
+  }
+
+  for (i = 0; i < hw->symbols_count; i++) {
+    uint32_t symbol = hw->sorted[i];
+    len = hw->keys[i] >> 16;
+    code = hw->first_code[len] + i - hw->first_index[len];
+    hw->codes[symbol] = code << 8 | len;
+    if (len <= WIDE_TABLE_BITS) {
+      uint32_t first = code << (WIDE_TABLE_BITS - len);
+      uint32_t last = first + (1U << (WIDE_TABLE_BITS - len));
+      for (; first < last; first++) {
+        hw->table[first] = symbol << 8 | len;
+      }
+    }
+  }
+  return 0;
+}
+
+huff_wide* huff_wide_init() {
+  huff_wide *hw = CALLOC(1, sizeof(*hw));
+  return hw;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(NULL);
+}
+
+huff_wide* huff_wide_destroy(huff_wide *hw) {
+  FREE(hw);
+  return hw;
+}
+
+uint64_t huff_wide_build(huff_wide *hw, const uint8_t *data, uint64_t size) {
+  uint64_t samples = size / sizeof(uint16_t);
+  uint64_t header_size = 2;
+  uint64_t bits = 0;
+  uint32_t prev = 0;
+  uint32_t symbol;
+  uint64_t i;
+
+  memset(hw->counts, 0, sizeof(hw->counts));
+  memset(hw->codes, 0, sizeof(hw->codes));
+  for (i = 0; i < samples; i++) {
+    uint16_t sample;
+    memcpy(&sample, &data[i * sizeof(sample)], sizeof(sample));
+    hw->counts[le16toh(sample)]++;
+  }
+
+  hw->symbols_count = 0;
+  for (symbol = 0; symbol < WIDE_SYMBOLS; symbol++) {
+    if (hw->counts[symbol]) {
+      hw->keys[hw->symbols_count++] = (uint64_t)hw->counts[symbol] << 16 | symbol;
+    }
+  }
+  header_size += huff_wide_varint_size(hw->symbols_count);
+  if (!hw->symbols_count) {
+    return header_size * CHAR_BIT;
+  }
+
+  qsort(hw->keys, hw->symbols_count, sizeof(*hw->keys), cmp_wide_keys);
+  for (i = 0; i < hw->symbols_count; i++) {
+    hw->sorted[i] = hw->keys[i] & 0xffff;
+    hw->weights[i] = hw->keys[i] >> 16;
+  }
+  huff_wide_lengths(hw->weights, hw->symbols_count);
+  huff_wide_limit(hw->weights, hw->symbols_count);
+  huff_wide_canonical(hw);
+
+  for (symbol = 0, i = 0; symbol < WIDE_SYMBOLS; symbol++) {
+    if (hw->counts[symbol]) {
+      header_size += huff_wide_varint_size(i++ ? symbol - prev - 1 : symbol) + 1;
+      bits += (uint64_t)hw->counts[symbol] * (hw->codes[symbol] & 0xff);
+      prev = symbol;
+    }
+  }
+  return header_size * CHAR_BIT + bits;
+}
+
+#define WIDE_APPEND_VARINT(buff, value)                                        \
+      ({                                                                       \
+        uint32_t tmp_value = (value);                                          \
+        while (tmp_value >= 0x80) {                                            \
+          BUFFER_APPEND_CHAR(buff, (tmp_value & 0x7f) | 0x80);                 \
+          tmp_value >>= 7;                                                     \
+        }                                                                      \
+        BUFFER_APPEND_CHAR(buff, tmp_value);                                   \
+      })
+
+int64_t huff_wide_encode(huff_wide *hw, const uint8_t *data, uint64_t size,
+                         buffer_t *buff_out) {
+  uint64_t samples = size / sizeof(uint16_t);
+  uint32_t prev = 0;
+  uint32_t symbol;
+  uint64_t i;
+
+  BUFFER_RESET(buff_out);
+
+  BUFFER_APPEND_CHAR(buff_out, size & 1);
+  BUFFER_APPEND_CHAR(buff_out, size & 1 ? data[size - 1] : 0);
+  WIDE_APPEND_VARINT(buff_out, hw->symbols_count);
+  for (symbol = 0, i = 0; symbol < WIDE_SYMBOLS; symbol++) {
+    if (hw->counts[symbol]) {
+      WIDE_APPEND_VARINT(buff_out, i++ ? symbol - prev - 1 : symbol);
+      BUFFER_APPEND_CHAR(buff_out, hw->codes[symbol] & 0xff);
+      prev = symbol;
+    }
+  }
+
+  for (i = 0; i < samples; i++) {
+    uint16_t sample;
+    memcpy(&sample, &data[i * sizeof(sample)], sizeof(sample));
+    uint32_t code = hw->codes[le16toh(sample)];
+    uint32_t bits = code >> 8;
+    uint32_t len = code & 0xff;
+    BUFFER_APPEND_BITS(buff_out, bits, len);
+  }
+  return BUFFER_FINISH(buff_out);
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int64_t huff_wide_read_varint(const uint8_t *src, uint64_t src_size,
+                                     uint64_t *position) {
+  uint32_t value = 0;
+  uint32_t shift;
+  for (shift = 0; shift < 21; shift += 7) {
+    if (*position >= src_size) {
+      return -1;
+    }
+    value |= (src[*position] & 0x7f) << shift;
+    if (!(src[(*position)++] & 0x80)) {
+      return value;
+    }
+  }
+  return -1;
+}
+
+int32_t huff_wide_decode(huff_wide *hw, buffer_t *buff_in, uint8_t *out,
+                         uint64_t size) {
+  const uint8_t *src = buff_in->buffer;
+  uint64_t samples = size / sizeof(uint16_t);
+  uint64_t position = 2;
+  int64_t value;
+  uint32_t symbol = 0;
+  uint64_t i;
+
+  if (buff_in->buffer_size < 2 || src[0] != (size & 1)) {
+    eprintf("Corrupted wide block\n");
+    ERROR_GOTO();
+  }
+  if (size & 1) {
+    out[size - 1] = src[1];
+  }
+
+  value = huff_wide_read_varint(src, buff_in->buffer_size, &position);
+  if (value < 0 || value > WIDE_SYMBOLS || (!value && samples)) {
+    eprintf("Corrupted wide block\n");
+    ERROR_GOTO();
+  }
+  hw->symbols_count = value;
+  for (i = 0; i < hw->symbols_count; i++) {
+    value = huff_wide_read_varint(src, buff_in->buffer_size, &position);
+    if (value < 0 || position >= buff_in->buffer_size) {
+      eprintf("Corrupted wide block\n");
+      ERROR_GOTO();
+    }
+    symbol = i ? symbol + value + 1 : (uint32_t)value;
+    if (symbol >= WIDE_SYMBOLS) {
+      eprintf("Corrupted wide block\n");
+      ERROR_GOTO();
+    }
+    hw->sorted[i] = symbol;
+    hw->weights[i] = src[position++];
+  }
+  if (!samples) {
+    return 0;
+  }
+  if (huff_wide_canonical(hw) < 0) {
+    eprintf("Corrupted wide block\n");
+    ERROR_GOTO();
+  }
+
+  buff_in->buffer_position = position;
+  buff_in->bit_position = CHAR_BIT;
+  BUFFER_BITS_INIT(buff_in);
+  for (i = 0; i < samples; i++) {
+    uint32_t entry, len;
+    BUFFER_BITS_REFILL(buff_in);
+    entry = hw->table[BUFFER_BITS_PEEK(buff_in, WIDE_TABLE_BITS)];
+    if (entry) {
+      symbol = entry >> 8;
+      len = entry & 0xff;
+    } else {
+      uint32_t bits = BUFFER_BITS_PEEK(buff_in, hw->max_bits);
+      for (len = WIDE_TABLE_BITS + 1; len <= hw->max_bits; len++) {
+        uint32_t offset = (bits >> (hw->max_bits - len)) - hw->first_code[len];
+        if (offset < hw->length_count[len]) {
+          symbol = hw->sorted[hw->first_index[len] + offset];
+          break;
+        }
+      }
+      if (len > hw->max_bits) {
+        eprintf("Corrupted wide block\n");
+        ERROR_GOTO();
+      }
+    }
+    BUFFER_BITS_SKIP(buff_in, len);
+    uint16_t sample = htole16(symbol);
+    memcpy(&out[i * sizeof(sample)], &sample, sizeof(sample));
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
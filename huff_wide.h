@@ -0,0 +1,100 @@
+/**
+ * @file       huff_wide.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for huffman coding of 16 bit symbols.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef HUFF_WIDE_H_
+#define HUFF_WIDE_H_
+
+#include <stdint.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include "error_handler.h"
+#include "macros.h"
+#include "buffer.h"
+
+
+#define WIDE_SYMBOLS (1 << 16)              /// Count of 16 bit symbols
+#define WIDE_MAX_BITS 24                    /// Longest code
+#define WIDE_TABLE_BITS 11                  /// Width of primary decode table
+#define WIDE_TABLE_SIZE (1 << WIDE_TABLE_BITS)
+
+ /**
+  * @struct huff_wide
+  * @brief This struct store canonical code for sparse 16 bit alphabet
+  * @details Only symbols that occur are stored in header, tree is never
+  * built, code lengths are computed in place from sorted counts.
+  */
+typedef struct huff_wide {
+  uint32_t counts[WIDE_SYMBOLS];    /**< Count of each symbol */
+  uint32_t codes[WIDE_SYMBOLS];     /**< Code << 8 | length by symbol */
+  uint32_t weights[WIDE_SYMBOLS];   /**< Counts, then lengths by rank */
+  uint64_t keys[WIDE_SYMBOLS];      /**< Sort keys */
+  uint16_t sorted[WIDE_SYMBOLS];    /**< Present symbols by rank */
+  uint32_t symbols_count;           /**< Count of present symbols */
+  uint32_t max_bits;                /**< Longest code length */
+  uint32_t first_code[WIDE_MAX_BITS + 2];  /**< First code of length */
+  uint32_t first_index[WIDE_MAX_BITS + 2]; /**< First rank of length */
+  uint32_t length_count[WIDE_MAX_BITS + 2]; /**< Codes of length */
+  uint32_t table[WIDE_TABLE_SIZE];  /**< Symbol << 8 | length, 0 if long */
+} huff_wide;
+
+/**
+ * @brief Create coder
+ * @return Pointer to new coder or NULL if failed
+ */
+huff_wide* huff_wide_init();
+
+/**
+ * @brief Free coder
+ *
+ * @param hw Coder
+ * @return NULL
+ */
+huff_wide* huff_wide_destroy(huff_wide *hw);
+
+/**
+ * @brief Count symbols and build code
+ * @details Data is read as little endian 16 bit samples, odd last byte is
+ * stored as is.
+ *
+ * @param hw Coder
+ * @param data Data to encode
+ * @param size Size of data in bytes
+ * @return Size of encoded data in bits
+ */
+uint64_t huff_wide_build(huff_wide *hw, const uint8_t *data, uint64_t size);
+
+/**
+ * @brief Encode data with code from huff_wide_build
+ *
+ * @param hw Coder
+ * @param data Data to encode
+ * @param size Size of data in bytes
+ * @param buff_out Memory buffer with enough space
+ * @return Size of encoded data or -1 if faild
+ */
+int64_t huff_wide_encode(huff_wide *hw, const uint8_t *data, uint64_t size,
+                         buffer_t *buff_out);
+
+/**
+ * @brief Decode data
+ *
+ * @param hw Coder
+ * @param buff_in Memory buffer with encoded data
+ * @param out Memory for decoded data
+ * @param size Size of decoded data in bytes
+ * @return 0 on success and -1 if faild
+ */
+int32_t huff_wide_decode(huff_wide *hw, buffer_t *buff_in, uint8_t *out,
+                         uint64_t size);
+
+#endif /* HUFF_WIDE_H_ */
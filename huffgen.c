@@ -0,0 +1,403 @@
+#include <stdio.h>
+#include <ctype.h>
+#include "huffman.h"
+
+#define HUFFGEN_LEAF 0x8000                 /// Node value is symbol
+#define HUFFGEN_NULL 0xffff                 /// Node has no child
+#define HUFFGEN_WORD_BITS 57                /// Valid bits of unaligned load
+#define HUFFGEN_ENTRIES_PER_LINE 3          /// Table entries per source line
+
+/**
+ * Macros to get width of generated declaration with name, so following
+ * lines of parameters are aligned.
+ */
+#define HUFFGEN_INDENT(name, declaration)                                      \
+      ((int)(strlen(name) + sizeof(declaration) - 1))
+
+ /**
+  * @struct huffgen_tree
+  * @brief This struct store tree of huff file flattened for generation
+  */
+typedef struct huffgen_tree {
+  huff_node *tree;                  /**< Root of tree */
+  uint64_t  tree_bits;              /**< Size of tree in file in bits */
+  uint8_t   tree_bytes[MAX_SYMBOLS * 2 * 2]; /**< Tree as written in file */
+  huff_node *internal[MAX_SYMBOLS]; /**< Internal nodes in node order */
+  uint16_t  nodes[MAX_SYMBOLS][2];  /**< Children of internal nodes */
+  uint32_t  nodes_count;            /**< Count of internal nodes */
+} huffgen_tree;
+
+static void print_usage();
+
+static bool huffgen_valid_name(const char *name) {
+  if (!*name || isdigit((unsigned char)*name)) {
+    return false;
+  }
+  for (; *name; name++) {
+    if (!isalnum((unsigned char)*name) && *name != '_') {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint16_t huffgen_flatten(huffgen_tree *ht, huff_node *hn) {
+  if (!hn) {
+    return HUFFGEN_NULL;
+  }
+  if (hn->is_leaf) {
+    return HUFFGEN_LEAF | hn->symbol;
+  }
+  uint32_t index = ht->nodes_count++;
+  ht->internal[index] = hn;
+  ht->nodes[index][0] = huffgen_flatten(ht, hn->left);
+  ht->nodes[index][1] = huffgen_flatten(ht, hn->right);
+  return index;
+}
+
+static uint16_t huffgen_node_index(const huffgen_tree *ht, huff_node *hn) {
+  uint32_t i;
+  for (i = 0; i < ht->nodes_count; i++) {
+    if (ht->internal[i] == hn) {
+      break;
+    }
+  }
+  return i;
+}
+
+/*
+ * Read tree of legacy huff file the same way decoder does, then copy its
+ * bits as they are in file.
+ */
+static int32_t huffgen_read_tree(const char *path, huffgen_tree *ht) {
+  buffer_t *buff = buffer_init(path, BUFFER_READ_MODE, BUFF_MIN_SIZE);
+  if (!buff) {
+    ERROR_GOTO();
+  }
+  uint64_t file_size = BUFFER_READ_EOF(buff);
+  if (file_size == BLOCK_MAGIC || file_size == RECORD_MAGIC) {
+    eprintf("%s: block and record archives have no single table\n", path);
+    ERROR_GOTO();
+  }
+  BUFFER_READ(buff);
+  BUFFER_BIT_SET_POSITION(buff, 8);
+  if (read_tree(&ht->tree, buff) < 0) {
+    ERROR_GOTO();
+  }
+
+  ht->tree_bits = huff_tree_size(ht->tree);
+  uint64_t tree_size = (ht->tree_bits + CHAR_BIT - 1) / CHAR_BIT;
+  if (tree_size > sizeof(ht->tree_bytes) ||
+      pread(buff->file, ht->tree_bytes, tree_size, sizeof(file_size)) !=
+      (ssize_t)tree_size) {
+    eprintf("%s: corrupted tree\n", path);
+    ERROR_GOTO();
+  }
+  if (ht->tree_bits % CHAR_BIT) {
+    uint32_t tail_bits = ht->tree_bits % CHAR_BIT;
+    ht->tree_bytes[tree_size - 1] &= 0xff << (CHAR_BIT - tail_bits);
+  }
+  if (!ht->tree->is_leaf) {
+    huffgen_flatten(ht, ht->tree);
+  }
+  buffer_destroy(buff);
+  return 0;
+_err:
+  ERROR_MSG();
+  if (buff) {
+    buffer_destroy(buff);
+  }
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Entry packs up to 4 symbols in low 32 bits, count of symbols in bits
+ * 32..39, used bits in 40..47 and node of long code in 48..63.
+ */
+static void huffgen_write_tables(FILE *out, const char *name,
+                                 const huffgen_tree *ht,
+                                 const huff_table *table) {
+  uint32_t i;
+
+  fprintf(out, "static const uint8_t %s_tree[%llu] = {", name,
+          (unsigned long long)(ht->tree_bits + CHAR_BIT - 1) / CHAR_BIT);
+  for (i = 0; i < (ht->tree_bits + CHAR_BIT - 1) / CHAR_BIT; i++) {
+    fprintf(out, "%s0x%02x,", i % 12 ? " " : "\n  ", ht->tree_bytes[i]);
+  }
+  fprintf(out, "\n};\n\n");
+
+  if (ht->tree->is_leaf) {
+    return;
+  }
+
+  fprintf(out, "static const uint16_t %s_nodes[%u][2] = {", name,
+          ht->nodes_count);
+  for (i = 0; i < ht->nodes_count; i++) {
+    fprintf(out, "%s{ 0x%04x, 0x%04x },",
+            i % HUFFGEN_ENTRIES_PER_LINE ? " " : "\n  ",
+            ht->nodes[i][0], ht->nodes[i][1]);
+  }
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "static const uint64_t %s_entries[%u] = {", name,
+          HUFF_TABLE_SIZE);
+  for (i = 0; i < HUFF_TABLE_SIZE; i++) {
+    const huff_table_entry *entry = &table->entries[i];
+    uint64_t packed = (uint64_t)entry->count << 32 |
+                      (uint64_t)entry->numbits << 40;
+    uint32_t s;
+    for (s = 0; s < entry->count; s++) {
+      packed |= (uint64_t)entry->symbols[s] << (s * CHAR_BIT);
+    }
+    if (!entry->count) {
+      packed |= (uint64_t)huffgen_node_index(
+                    ht, table->subtrees[entry->subtree]) << 48;
+    }
+    fprintf(out, "%s0x%016llxULL,",
+            i % HUFFGEN_ENTRIES_PER_LINE ? " " : "\n  ",
+            (unsigned long long)packed);
+  }
+  fprintf(out, "\n};\n\n");
+}
+
+/*
+ * Walk of nodes is used for codes longer than table index and for last
+ * symbols, where unaligned loads would pass end of input.
+ */
+static void huffgen_write_walk(FILE *out, const char *name) {
+  fprintf(out,
+    "static int32_t %s_walk(const uint8_t *in, uint64_t in_size,\n"
+    "%*suint64_t *pos, uint32_t node, uint8_t *out) {\n"
+    "  while (1) {\n"
+    "    if (*pos >= in_size * 8) {\n"
+    "      return -1;\n"
+    "    }\n"
+    "    uint32_t bit = in[*pos >> 3] >> (7 - (*pos & 7)) & 1;\n"
+    "    uint32_t next = %s_nodes[node][bit];\n"
+    "    (*pos)++;\n"
+    "    if (next == 0x%04x) {\n"
+    "      return -1;\n"
+    "    }\n"
+    "    if (next & 0x%04x) {\n"
+    "      *out = (uint8_t)next;\n"
+    "      return 0;\n"
+    "    }\n"
+    "    node = next;\n"
+    "  }\n"
+    "}\n\n", name, HUFFGEN_INDENT(name, "static int32_t _walk("), "", name,
+    HUFFGEN_NULL, HUFFGEN_LEAF);
+}
+
+/*
+ * One step of unrolled loop. Index is taken from word loaded before loop,
+ * no refill is needed inside it.
+ */
+static void huffgen_write_step(FILE *out, const char *name,
+                               uint32_t max_symbols, bool long_codes) {
+  fprintf(out,
+    "    entry = %s_entries[word << used >> %u];\n", name,
+    UINT64_BIT - HUFF_TABLE_BITS);
+  if (long_codes) {
+    fprintf(out,
+      "    if (!(entry >> 32 & 0xff)) {\n"
+      "      pos += used + %u;\n"
+      "      if (%s_walk(in, in_size, &pos, entry >> 48, out++) < 0) {\n"
+      "        return -1;\n"
+      "      }\n"
+      "      count--;\n"
+      "      continue;\n"
+      "    }\n", HUFF_TABLE_BITS, name);
+  }
+  if (max_symbols == 1) {
+    fprintf(out,
+      "    *out++ = (uint8_t)entry;\n"
+      "    count--;\n");
+  } else {
+    fprintf(out,
+      "    symbols = htole32((uint32_t)entry);\n"
+      "    memcpy(out, &symbols, sizeof(symbols));\n"
+      "    out += entry >> 32 & 0xff;\n"
+      "    count -= entry >> 32 & 0xff;\n");
+  }
+  fprintf(out,
+    "    used += entry >> 40 & 0xff;\n");
+}
+
+static void huffgen_write_decode(FILE *out, const char *name,
+                                 const huffgen_tree *ht,
+                                 const huff_table *table) {
+  uint32_t unroll = HUFFGEN_WORD_BITS / HUFF_TABLE_BITS;
+  bool long_codes = huff_tree_depth(ht->tree) > HUFF_TABLE_BITS;
+  uint32_t i;
+
+  fprintf(out,
+    "int32_t %s_decode(const uint8_t *in, uint64_t in_size,\n"
+    "%*suint64_t bit_offset, uint8_t *out, uint64_t count) {\n",
+    name, HUFFGEN_INDENT(name, "int32_t _decode("), "");
+  if (ht->tree->is_leaf) {
+    fprintf(out,
+      "  (void)in;\n"
+      "  (void)in_size;\n"
+      "  (void)bit_offset;\n"
+      "  memset(out, %u, count);\n"
+      "  return 0;\n"
+      "}\n\n", ht->tree->symbol);
+    return;
+  }
+
+  fprintf(out,
+    "  uint64_t pos = bit_offset;\n"
+    "  uint64_t entry;\n"
+    "%s"
+    "\n"
+    "  while (count >= %u && (pos >> 3) + 8 <= in_size) {\n"
+    "    uint64_t word;\n"
+    "    uint32_t used = 0;\n"
+    "    memcpy(&word, &in[pos >> 3], sizeof(word));\n"
+    "    word = be64toh(word) << (pos & 7);\n",
+    table->max_symbols > 1 ? "  uint32_t symbols;\n" : "",
+    unroll * table->max_symbols);
+  for (i = 0; i < unroll; i++) {
+    huffgen_write_step(out, name, table->max_symbols, long_codes);
+  }
+  fprintf(out,
+    "    pos += used;\n"
+    "  }\n"
+    "\n"
+    "  for (; count; count--) {\n"
+    "    if (%s_walk(in, in_size, &pos, 0, out++) < 0) {\n"
+    "      return -1;\n"
+    "    }\n"
+    "  }\n"
+    "  return 0;\n"
+    "}\n\n", name);
+}
+
+static void huffgen_write_decode_file(FILE *out, const char *name,
+                                      const huffgen_tree *ht) {
+  uint64_t tree_size = ht->tree_bits / CHAR_BIT;
+  uint32_t tail_bits = ht->tree_bits % CHAR_BIT;
+
+  fprintf(out,
+    "int64_t %s_decode_file(const uint8_t *in, uint64_t in_size,\n"
+    "%*suint8_t *out, uint64_t out_size) {\n"
+    "  uint64_t size;\n"
+    "  if (in_size < 8 + sizeof(%s_tree)) {\n"
+    "    return -1;\n"
+    "  }\n"
+    "  memcpy(&size, in, sizeof(size));\n"
+    "  size = le64toh(size);\n"
+    "  if (size > out_size ||\n"
+    "      memcmp(&in[8], %s_tree, %llu)", name,
+    HUFFGEN_INDENT(name, "int64_t _decode_file("), "", name, name,
+    (unsigned long long)tree_size);
+  if (tail_bits) {
+    fprintf(out, " ||\n"
+      "      (in[%llu] & 0x%02x) != %s_tree[%llu]",
+      (unsigned long long)(8 + tree_size),
+      (0xff << (CHAR_BIT - tail_bits)) & 0xff, name,
+      (unsigned long long)tree_size);
+  }
+  fprintf(out, ") {\n"
+    "    return -1;\n"
+    "  }\n"
+    "  if (%s_decode(in, in_size, %s_CODES_OFFSET, out, size) < 0) {\n"
+    "    return -1;\n"
+    "  }\n"
+    "  return size;\n"
+    "}\n", name, name);
+}
+
+/*
+ * Write C source with constant tables and decode routines specialized for
+ * tree: tree of one symbol is memset, entries of one symbol are stored
+ * without count, walk of long codes is left out if all codes fit index.
+ */
+static int32_t huffgen_write(const char *path_in, const char *name,
+                             const char *path_out) {
+  huffgen_tree ht = { 0 };
+  huff_table *table = NULL;
+  FILE *out = NULL;
+
+  if (huffgen_read_tree(path_in, &ht) < 0) {
+    ERROR_GOTO();
+  }
+  table = huff_table_init(ht.tree, huff_table_choose_symbols(ht.tree));
+  if (!table) {
+    ERROR_GOTO();
+  }
+  out = fopen(path_out, "w");
+  if (!out) {
+    eprintf("Cant open file %s\n", path_out);
+    ERROR_GOTO();
+  }
+
+  fprintf(out,
+    "/*\n"
+    " * Decoder of fixed huffman table, generated by huffgen from %s.\n"
+    " * Do not edit, run huffgen again if table changes.\n"
+    " *\n"
+    " * %s_decode decodes count symbols from bitstream in starting at bit\n"
+    " * bit_offset, most significant bit first. %s_decode_file decodes\n"
+    " * whole huff file coded with this table, it returns decoded size or\n"
+    " * -1 if file has other table or is corrupted.\n"
+    " */\n"
+    "\n"
+    "#include <stdint.h>\n"
+    "#include <string.h>\n"
+    "#include <endian.h>\n"
+    "\n"
+    "#define %s_CODES_OFFSET %llu\n"
+    "\n"
+    "int32_t %s_decode(const uint8_t *in, uint64_t in_size,\n"
+    "%*suint64_t bit_offset, uint8_t *out, uint64_t count);\n"
+    "int64_t %s_decode_file(const uint8_t *in, uint64_t in_size,\n"
+    "%*suint8_t *out, uint64_t out_size);\n"
+    "\n", path_in, name, name, name,
+    (unsigned long long)(UINT64_BIT + ht.tree_bits),
+    name, HUFFGEN_INDENT(name, "int32_t _decode("), "",
+    name, HUFFGEN_INDENT(name, "int64_t _decode_file("), "");
+
+  huffgen_write_tables(out, name, &ht, table);
+  if (!ht.tree->is_leaf) {
+    huffgen_write_walk(out, name);
+  }
+  huffgen_write_decode(out, name, &ht, table);
+  huffgen_write_decode_file(out, name, &ht);
+
+  if (fclose(out)) {
+    out = NULL;
+    ERROR_GOTO();
+  }
+  huff_table_destroy(table);
+  huff_tree_destroy(ht.tree);
+  return 0;
+_err:
+  ERROR_MSG();
+  if (out) {
+    fclose(out);
+  }
+  huff_table_destroy(table);
+  huff_tree_destroy(ht.tree);
+  ERROR_RETURN(-1);
+}
+
+int main(int argc, char *const *argv) {
+  if (argc != 4) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+  if (!huffgen_valid_name(argv[2])) {
+    eprintf("%s: name must be C identifier\n", argv[2]);
+    return EXIT_FAILURE;
+  }
+  return huffgen_write(argv[1], argv[2], argv[3]) ? EXIT_FAILURE :
+                                                    EXIT_SUCCESS;
+}
+
+static void print_usage() {
+  puts("Usage: huffgen table name ofile\n"
+      "table - huff file without blocks and records, its tree is the table\n"
+      "name - prefix of generated functions and tables\n"
+      "ofile - output C file with name_decode and name_decode_file\n");
+}
@@ -1,12 +1,15 @@
 #include "huffman.h"
 
-static int32_t write_huff_codes(huff_code *hnct[], buffer_t *buff_in, buffer_t *buff_out) {
+static int32_t write_huff_codes(huff_code *hnct[], const huff_pair_table *pairs,
+                                buffer_t *buff_in, buffer_t *buff_out,
+                                progress_t *progress) {
   uint8_t *pbuff_in;
   while ((pbuff_in = BUFFER_READ(buff_in)) != NULL) {
-    uint64_t i;
-    for (i = 0; i < buff_in->buffer_size; i++) {
-      BUFFER_APPEND_HUFF_CODE(buff_out, hnct[pbuff_in[i]]);
+    if (huff_codes_append(hnct, pairs, pbuff_in, buff_in->buffer_size,
+                          buff_out) < 0) {
+      ERROR_GOTO();
     }
+    PROGRESS_UPDATE(progress, buff_in->buffer_size);
   }
   return 0;
 _err:
@@ -14,50 +17,201 @@ _err:
   ERROR_RETURN(-1);
 }
 
-static int32_t read_huff_codes(huff_node *tree, buffer_t *buff_in, buffer_t *buff_out, uint64_t file_size) {
-  uint8_t decoded_char;
-  uint32_t j = file_size;
-  while (j--) {
-    read_huff_code(tree, buff_in, &decoded_char);
-    BUFFER_APPEND_CHAR(buff_out, decoded_char);
-
+static int32_t read_huff_codes(huff_node *tree, buffer_t *buff_in, buffer_t *buff_out,
+                               uint64_t file_size, huff_table_cache *cache,
+                               bool map_output, progress_t *progress) {
+  uint64_t left = file_size;
+  uint8_t *map = map_output ? buffer_map(buff_out, file_size) : NULL;
+  uint64_t step = map ? buff_in->buffer_capacity : buff_out->buffer_capacity;
+  huff_table *table = cache ? huff_table_cache_get(cache, tree) :
+                      huff_table_init(tree, huff_table_choose_symbols(tree));
+  if (!table) {
+    ERROR_GOTO();
+  }
+  BUFFER_BITS_INIT(buff_in);
+  while (left) {
+    uint64_t chunk = left < step ? left : step;
+    uint8_t *out = map ? &map[file_size - left] : buff_out->buffer;
+    left -= chunk;
+    if (huff_table_decode(table, buff_in, out, chunk) < 0) {
+      ERROR_GOTO();
+    }
+    if (!map) {
+      BUFFER_WRITE_BYTES(buff_out, chunk);
+    }
+    PROGRESS_UPDATE(progress, chunk);
+  }
+  if (map && buffer_unmap(buff_out, map, file_size) < 0) {
+    map = NULL;
+    ERROR_GOTO();
+  }
+  if (!cache) {
+    huff_table_destroy(table);
+    huff_tree_destroy(tree);
   }
-  buff_out++;
   return 0;
 _err:
   ERROR_MSG();
+  if (map) {
+    munmap(map, file_size);
+  }
+  if (!cache) {
+    huff_table_destroy(table);
+    huff_tree_destroy(tree);
+  }
   ERROR_RETURN(-1);
 }
 
-int32_t huffman_encode_file(const char *path_in, const char *path_out) {
-  buffer_t *input_buff;
-  buffer_t *output_buff;
+static perf_t* huffman_perf_start(perf_t *perf, const huff_params *params) {
+  if (!params->profile) {
+    return NULL;
+  }
+  perf_init(perf);
+  return perf;
+}
+
+static void huffman_perf_finish(perf_t *perf) {
+  if (perf) {
+    perf_report(perf);
+    perf_destroy(perf);
+  }
+}
+
+int32_t huffman_encode_buffers(buffer_t *input_buff, buffer_t *output_buff,
+                               const huff_params *params) {
   huff_node *hnt[MAX_SYMBOLS] = {NULL};
   huff_code *hnc[MAX_SYMBOLS] = {NULL};
+  progress_t progress_st = { .interval = params->progress_interval };
+  progress_t *progress = params->progress_interval > 0 ? &progress_st : NULL;
+  struct stat input_stat;
+  perf_t perf_st;
+  perf_t *perf = huffman_perf_start(&perf_st, params);
+  huff_parallel *hp = NULL;
+  huff_pair_table *pairs = NULL;
+  numa_topology topo;
+  int32_t symbols_count = 0;
+  int32_t ret;
 
-  input_buff = buffer_init(path_in, BUFFER_READ_MODE, BUFF_MAX_SIZE);
-  output_buff = buffer_init(path_out, BUFFER_WRITE_MODE, BUFF_MAX_SIZE);
+  if (fstat(input_buff->file, &input_stat) < 0) {
+    ERROR_GOTO();
+  }
 
+  if (params->records) {
+    PERF_BEGIN(perf, "record_encode");
+    ret = record_encode(input_buff, output_buff, RECORD_DELIMITER, progress);
+    PERF_END(perf, input_stat.st_size);
+    huffman_perf_finish(perf);
+    return ret;
+  }
+
+  if (params->block_size) {
+    PROGRESS_START(progress, "encode", input_stat.st_size);
+    PERF_BEGIN(perf, "block_encode");
+    ret = block_encode(input_buff, output_buff,
+                       (params->wide ? BLOCK_ENCODE_WIDE : 0) |
+                       (params->split ? BLOCK_ENCODE_SPLIT : 0) |
+                       (params->transform ? BLOCK_ENCODE_MTF : 0) |
+                       (params->append ? BLOCK_ENCODE_APPEND : 0), progress);
+    PERF_END(perf, input_stat.st_size);
+    PROGRESS_FINISH(progress);
+    huffman_perf_finish(perf);
+    return ret;
+  }
 
   BUFFER_SKIP_EOF(output_buff);
 
   huff_nodes_init(hnt);
+  if (params->workers > 1) {
+    bool numa = params->numa && numa_topology_init(&topo) == 0;
+    if (numa && params->profile) {
+      numa_report(&topo, params->workers);
+    }
+    hp = huff_parallel_init(input_buff->file, params->workers,
+                            numa ? &topo : NULL);
+  }
 
-  uint64_t file_size = clalculate_symbol_frequancy(hnt, input_buff);
+  PROGRESS_START(progress, "histogram", input_stat.st_size);
+  PERF_BEGIN(perf, "histogram");
+  int64_t file_size = hp ? huff_parallel_histogram(hp, hnt, progress) :
+                      clalculate_symbol_frequancy(hnt, input_buff, progress);
+  if (file_size < 0) {
+    ERROR_GOTO();
+  }
+  PERF_END(perf, file_size);
+  PROGRESS_FINISH(progress);
 
-  construct_tree(hnt);
+  PERF_BEGIN(perf, "write_tree");
+  symbols_count = construct_tree(hnt);
 
   BUFFER_REWIND(input_buff);
 
   write_tree(hnt[0], output_buff, hnc);
+  PERF_END(perf, file_size);
 
-  write_huff_codes(hnc, input_buff, output_buff);
+  PROGRESS_START(progress, "encode", file_size);
+  PERF_BEGIN(perf, "write_huff_codes");
+  if (file_size >= HUFF_PAIR_MIN_SIZE) {
+    pairs = huff_pair_table_init(hnc);
+  }
+  ret = hp ? huff_parallel_codes(hp, hnc, pairs, output_buff, progress) :
+             write_huff_codes(hnc, pairs, input_buff, output_buff, progress);
+  if (ret < 0) {
+    ERROR_GOTO();
+  }
+  PERF_END(perf, file_size);
+  PROGRESS_FINISH(progress);
 
   BUFFER_WRITE_EOF(output_buff, file_size);
+  huffman_perf_finish(perf);
+
+  huff_pair_table_destroy(pairs);
+  huff_parallel_destroy(hp);
+  huff_nodes_destroy(hnt, symbols_count);
+  huff_codes_destroy(hnc);
+  return 0;
+
+_err:
+  huffman_perf_finish(perf);
+  huff_pair_table_destroy(pairs);
+  huff_parallel_destroy(hp);
+  huff_nodes_destroy(hnt, symbols_count);
+  huff_codes_destroy(hnc);
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Attach direct I/O to file buffers if asked. Buffer that can not use it
+ * stays on plain path.
+ */
+static void huffman_direct_io(buffer_t *input_buff, buffer_t *output_buff,
+                              const huff_params *params) {
+  if (params->io_depth) {
+    buffer_io_attach(input_buff, params->io_depth);
+    buffer_io_attach(output_buff, params->io_depth);
+  }
+}
+
+int32_t huffman_encode_file(const char *path_in, const char *path_out,
+                            const huff_params *params) {
+  buffer_t *input_buff;
+  buffer_t *output_buff;
+  int32_t ret;
+
+  input_buff = buffer_init(path_in, BUFFER_READ_MODE,
+                  params->block_size ? params->block_size : params->buffer_size);
+  output_buff = buffer_init(path_out,
+                  params->append ? BUFFER_APPEND_MODE : BUFFER_WRITE_MODE,
+                  params->block_size ? BUFF_MIN_SIZE : params->buffer_size);
+  if (!input_buff || !output_buff) {
+    ERROR_GOTO();
+  }
+  huffman_direct_io(input_buff, output_buff, params);
+
+  ret = huffman_encode_buffers(input_buff, output_buff, params);
 
   buffer_destroy(input_buff);
   buffer_destroy(output_buff);
-  return 0;
+  return ret;
 
 _err:
   ERROR_RETURN(-1);
@@ -66,32 +220,146 @@ _err:
 
 
 
-int32_t huffman_decode_file(const char *path_in, const char *path_out) {
-  buffer_t *input_buff;
-  buffer_t *output_buff;
+int32_t huffman_decode_buffers(buffer_t *input_buff, buffer_t *output_buff,
+                               const huff_params *params) {
   huff_node *tree = NULL;
+  progress_t progress_st = { .interval = params->progress_interval };
+  progress_t *progress = params->progress_interval > 0 ? &progress_st : NULL;
+  perf_t perf_st;
+  perf_t *perf = huffman_perf_start(&perf_st, params);
+  struct stat input_stat;
 
-  input_buff = buffer_init(path_in, BUFFER_READ_MODE, BUFF_MAX_SIZE);
-  output_buff = buffer_init(path_out, BUFFER_WRITE_MODE, BUFF_MAX_SIZE);
+  if (fstat(input_buff->file, &input_stat) < 0) {
+    ERROR_GOTO();
+  }
 
   uint64_t file_size = BUFFER_READ_EOF(input_buff);
 
+  if (file_size == BLOCK_MAGIC) {
+    PROGRESS_START(progress, "decode", 0);
+    PERF_BEGIN(perf, "block_decode");
+    int32_t ret = block_decode(input_buff, output_buff, params->map_output,
+                               progress);
+    PERF_END(perf, lseek(output_buff->file, 0, SEEK_CUR));
+    PROGRESS_FINISH(progress);
+    huffman_perf_finish(perf);
+    return ret;
+  }
+
+  if (file_size == RECORD_MAGIC) {
+    PROGRESS_START(progress, "decode", 0);
+    PERF_BEGIN(perf, "record_decode");
+    int32_t ret = record_decode(input_buff, output_buff, params->map_output,
+                                progress);
+    PERF_END(perf, lseek(output_buff->file, 0, SEEK_CUR));
+    PROGRESS_FINISH(progress);
+    huffman_perf_finish(perf);
+    return ret;
+  }
+
   BUFFER_READ(input_buff);
 
   BUFFER_BIT_SET_POSITION(input_buff, 8);
 
-  read_tree(&tree, input_buff);
+  PERF_BEGIN(perf, "read_tree");
+  if (read_tree(&tree, input_buff) < 0) {
+    ERROR_GOTO();
+  }
+  PERF_END(perf, file_size);
 
+  /* Every symbol takes at least one bit unless tree has one leaf. */
+  if (!tree->is_leaf && file_size / CHAR_BIT > (uint64_t)input_stat.st_size) {
+    eprintf("Corrupted file size\n");
+    ERROR_GOTO();
+  }
 
-  read_huff_codes(tree, input_buff, output_buff, file_size);
+  PROGRESS_START(progress, "decode", file_size);
+  PERF_BEGIN(perf, "read_huff_codes");
+  int32_t ret = read_huff_codes(tree, input_buff, output_buff, file_size,
+                                params->table_cache, params->map_output,
+                                progress);
+  tree = NULL;
+  if (ret < 0) {
+    ERROR_GOTO();
+  }
+  PERF_END(perf, file_size);
+  PROGRESS_FINISH(progress);
 
   BUFFER_WRITE_END(output_buff);
+  huffman_perf_finish(perf);
+  return 0;
+_err:
+  ERROR_MSG();
+  huffman_perf_finish(perf);
+  huff_tree_destroy(tree);
+  ERROR_RETURN(-1);
+}
 
+int32_t huffman_decode_file(const char *path_in, const char *path_out,
+                            const huff_params *params) {
+  buffer_t *input_buff;
+  buffer_t *output_buff;
+  int32_t ret;
+
+  input_buff = buffer_init(path_in, BUFFER_READ_MODE, params->buffer_size);
+  output_buff = buffer_init(path_out, BUFFER_WRITE_MODE,
+                  params->map_output ? BUFF_MIN_SIZE : params->buffer_size);
+  if (!input_buff || !output_buff) {
+    ERROR_GOTO();
+  }
+  huffman_direct_io(input_buff, output_buff, params);
+
+  ret = huffman_decode_buffers(input_buff, output_buff, params);
 
   buffer_destroy(input_buff);
   buffer_destroy(output_buff);
+  return ret;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+int32_t huffman_get_record(const char *path_in, const char *path_out,
+                           uint64_t record_id) {
+  record_reader *rr = NULL;
+  uint8_t *record = NULL;
+  int fildes_in = -1;
+  int fildes_out = -1;
+  int64_t size;
+
+  fildes_in = OPEN(path_in, O_RDONLY);
+  rr = record_open(fildes_in);
+  if (!rr) {
+    ERROR_GOTO();
+  }
+  size = record_size(rr, record_id);
+  if (size < 0) {
+    eprintf("No record %llu\n", (unsigned long long)record_id);
+    ERROR_GOTO();
+  }
+  record = MALLOC(size + 1);
+  if (record_get(rr, record_id, record, size) < 0) {
+    ERROR_GOTO();
+  }
+  fildes_out = OPEN(path_out, O_CREAT | O_WRONLY | O_TRUNC);
+  WRITE(record, sizeof(*record), size, fildes_out);
+
+  CLOSE(fildes_out);
+  CLOSE(fildes_in);
+  FREE(record);
+  record_close(rr);
   return 0;
 _err:
   ERROR_MSG();
+  if (fildes_out >= 0) {
+    close(fildes_out);
+  }
+  if (fildes_in >= 0) {
+    close(fildes_in);
+  }
+  FREE(record);
+  if (rr) {
+    record_close(rr);
+  }
   ERROR_RETURN(-1);
 }
@@ -15,9 +15,62 @@
 
 #include <endian.h>
 #include "huff_nodes.h"
+#include "huff_table.h"
+#include "block.h"
+#include "huff_stream.h"
+#include "huff_parallel.h"
+#include "record.h"
 #include "error_handler.h"
 #include "eof.h"
 #include "buffer.h"
+#include "buffer_io.h"
+#include "progress.h"
+#include "perf.h"
+
+
+ /**
+  * @struct huff_params
+  * @brief This struct store options for encoding and decoding
+  */
+typedef struct huff_params {
+  uint64_t buffer_size;             /**< Size of input and output buffers */
+  double   progress_interval;       /**< Seconds between reports, 0 is off */
+  uint64_t block_size;              /**< Size of archive block, 0 is off */
+  bool     profile;                 /**< Measure phases with perf counters */
+  bool     wide;                    /**< Try 16 bit symbols in blocks */
+  bool     split;                   /**< Choose block boundaries by entropy */
+  bool     transform;               /**< Try MTF and zero run in blocks */
+  bool     append;                  /**< Add blocks to existing archive */
+  bool     records;                 /**< Write record archive of lines */
+  uint32_t io_depth;                /**< Requests of direct I/O, 0 is off */
+  uint32_t workers;                 /**< Threads of legacy encoder, 0 or 1
+                                         is serial */
+  bool     map_output;              /**< Decode straight to mapped file */
+  bool     numa;                    /**< Pin workers and keep their memory
+                                         on their node */
+  huff_table_cache *table_cache;    /**< Reuse decode tables, NULL is off */
+} huff_params;
+
+/**
+ * Macros to init params with default values.
+ */
+#define HUFF_PARAMS_DEFAULT                                                    \
+      {                                                                        \
+        .buffer_size = BUFF_MAX_SIZE,                                          \
+        .progress_interval = 0,                                                \
+        .block_size = 0,                                                       \
+        .profile = false,                                                      \
+        .wide = false,                                                         \
+        .split = false,                                                        \
+        .transform = false,                                                    \
+        .append = false,                                                       \
+        .records = false,                                                      \
+        .io_depth = 0,                                                         \
+        .workers = 0,                                                          \
+        .map_output = false,                                                   \
+        .numa = false,                                                         \
+        .table_cache = NULL,                                                   \
+      }
 
 
  /**
@@ -27,24 +80,74 @@
   * frequancy table. After that writing tree in output file and create 
   * huffman codes table. Read input file from start and encode each cahr with 
   * huffman codes talble.  
+  * If block size is set then input is written as block archive, each
+  * block is coded with huffman, FSE or stored as is. Wide mode also tries
+  * 16 bit symbols for each block. Split mode cuts input to blocks where
+  * statistics change.
   * 
   * @param path_in Path to file for encoding
   * @param path_out Path to file for save encoding
+  * @param params Options for encoding
   *
   * @return 0 if success or 1 if failed
   */
-int32_t huffman_encode_file(const char *path_in, const char *path_out);
+int32_t huffman_encode_file(const char *path_in, const char *path_out,
+                            const huff_params *params);
+
+ /**
+  * @brief Encoding opened files attached to buffers
+  * @details Same as huffman_encode_file, but buffers are created by caller
+  * and can be reused. Input file must be seekable, output file must be
+  * seekable and positioned at start. In block mode capacity of input buffer
+  * is size of block.
+  *
+  * @param input_buff Buffer with input file
+  * @param output_buff Buffer with output file
+  * @param params Options for encoding
+  *
+  * @return 0 if success or -1 if failed
+  */
+int32_t huffman_encode_buffers(buffer_t *input_buff, buffer_t *output_buff,
+                               const huff_params *params);
 
 /**
   * @brief Decoding file that is on path_in and writing to path_out
-  * @details Read huffman tree from input file and decode input file with that tree
+  * @details Read huffman tree from input file and decode input file with that tree.
+  * Block and record archives are detected by magic at start of file.
   *
   * @param path_in Path to file for decoding
   * @param path_out Path to file for save decoding
+  * @param params Options for decoding
   *
   * @return 0 if success or 1 if failed
   */
-int32_t huffman_decode_file(const char *path_in, const char *path_out);
+int32_t huffman_decode_file(const char *path_in, const char *path_out,
+                            const huff_params *params);
+
+/**
+  * @brief Decoding opened files attached to buffers
+  * @details Same as huffman_decode_file, but buffers are created by caller
+  * and can be reused.
+  *
+  * @param input_buff Buffer with input file
+  * @param output_buff Buffer with output file
+  * @param params Options for decoding
+  *
+  * @return 0 if success or -1 if failed
+  */
+int32_t huffman_decode_buffers(buffer_t *input_buff, buffer_t *output_buff,
+                               const huff_params *params);
 
+/**
+  * @brief Decode one record of record archive on path_in to path_out
+  *
+  * @param path_in Path to record archive
+  * @param path_out Path to file for record
+  * @param record_id Number of record from 0
+  *
+  * @return 0 if success or -1 if failed
+  */
+int32_t huffman_get_record(const char *path_in, const char *path_out,
+                           uint64_t record_id);
 
 #endif /* HUFFFMAN_H_ */
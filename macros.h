@@ -72,7 +72,7 @@
       ({                                                                       \
         int tmp_file_desc = open(path, mode, S_IRUSR | S_IWUSR |               \
                                              S_IRGRP | S_IROTH);               \
-        if (!tmp_file_desc) {                                                  \
+        if (tmp_file_desc < 0) {                                               \
           eprintf("Cant open file %s\n", path);                                \
           ERROR_GOTO();                                                        \
         }                                                                      \
@@ -110,7 +110,7 @@
  */
 #define CLOSE(fildes)                                                          \
       ({                                                                       \
-        if (fildes) {                                                          \
+        if (fildes > 0) {                                                      \
           if (close(fildes) < 0) {                                             \
             eprintf("Error while closing fildes");                             \
             ERROR_GOTO();                                                      \
@@ -1,38 +1,204 @@
 #include <stdio.h>
 #include <getopt.h>
+#include <sys/resource.h>
 #include "huffman.h"
+#include "serve.h"
+#include "estimate.h"
 
 static void print_usage();
+static void print_peak_memory();
 
 int main(int argc, char *const *argv) {
   int opt;
+  int mode = 0;
+  int32_t ret = 0;
+  bool report_memory = false;
+  bool buffer_size_set = false;
+  const char *serve_path = NULL;
+  uint32_t workers_count = 0;
+  uint64_t record_id = 0;
+  bool cache_tables = false;
+  bool estimate = false;
+  uint32_t sample_stride = 0;
+  huff_params params = HUFF_PARAMS_DEFAULT;
+  static const struct option long_options[] = {
+    { "serve", required_argument, NULL, 'S' },
+    { "workers", required_argument, NULL, 'W' },
+    { "cache-tables", no_argument, NULL, 'T' },
+    { "estimate", no_argument, NULL, 'E' },
+    { "sample", required_argument, NULL, 'N' },
+    { "queue-depth", required_argument, NULL, 'Q' },
+    { "numa", no_argument, NULL, 'U' },
+    { NULL, 0, NULL, 0 },
+  };
 
-  if (argc != 4) {
-    print_usage();
-    return 0;
-  }
-
-  while ((opt = getopt(argc, argv, "cx")) != -1) {
+  while ((opt = getopt_long(argc, argv, "cxlb:mp:B:PwatARg:DM", long_options, NULL)) != -1) {
     switch (opt) {
       case 'c':
-        huffman_encode_file(argv[1], argv[3]);
-        break;
       case 'x':
-        huffman_decode_file(argv[1], argv[3]);
+        mode = opt;
+        break;
+      case 'l':
+        params.buffer_size = BUFF_LOW_MEM_SIZE;
+        buffer_size_set = true;
+        break;
+      case 'b':
+        params.buffer_size = strtoull(optarg, NULL, 0);
+        buffer_size_set = true;
+        break;
+      case 'm':
+        report_memory = true;
+        break;
+      case 'p':
+        params.progress_interval = strtod(optarg, NULL);
+        break;
+      case 'B':
+        params.block_size = strtoull(optarg, NULL, 0);
+        break;
+      case 'P':
+        params.profile = true;
+        break;
+      case 'w':
+        params.wide = true;
+        break;
+      case 'a':
+        params.split = true;
+        break;
+      case 't':
+        params.transform = true;
+        break;
+      case 'A':
+        params.append = true;
+        break;
+      case 'R':
+        params.records = true;
+        break;
+      case 'g':
+        mode = opt;
+        record_id = strtoull(optarg, NULL, 0);
+        break;
+      case 'S':
+        serve_path = optarg;
+        break;
+      case 'W':
+        workers_count = strtoul(optarg, NULL, 0);
+        break;
+      case 'T':
+        cache_tables = true;
+        break;
+      case 'E':
+        estimate = true;
+        break;
+      case 'N':
+        sample_stride = strtoul(optarg, NULL, 0);
+        break;
+      case 'D':
+        if (!params.io_depth) {
+          params.io_depth = BUFFER_IO_DEFAULT_DEPTH;
+        }
+        break;
+      case 'Q':
+        params.io_depth = strtoul(optarg, NULL, 0);
+        break;
+      case 'M':
+        params.map_output = true;
+        break;
+      case 'U':
+        params.numa = true;
         break;
       default:
         print_usage();
-        break;
+        return 0;
+    }
+  }
+
+  if (serve_path) {
+    if (!buffer_size_set) {
+      params.buffer_size = BUFF_LOW_MEM_SIZE;
+    }
+    ret = huffman_serve(serve_path, workers_count, cache_tables, &params);
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  if (estimate) {
+    if (optind == argc) {
+      print_usage();
+      return 0;
     }
+    ret = huffman_estimate(&argv[optind], argc - optind, workers_count,
+                           sample_stride);
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
   }
 
-  return 0;
+  if (!mode || argc - optind != 2) {
+    print_usage();
+    return 0;
+  }
+  params.workers = workers_count;
+  if (params.split && !params.block_size) {
+    params.block_size = BLOCK_SPLIT_DEFAULT_SIZE;
+  }
+  if ((params.wide || params.transform || params.append) &&
+      !params.block_size) {
+    params.block_size = BLOCK_DEFAULT_SIZE;
+  }
+
+  switch (mode) {
+    case 'c':
+      ret = huffman_encode_file(argv[optind], argv[optind + 1], &params);
+      break;
+    case 'x':
+      ret = huffman_decode_file(argv[optind], argv[optind + 1], &params);
+      break;
+    case 'g':
+      ret = huffman_get_record(argv[optind], argv[optind + 1], record_id);
+      break;
+  }
+
+  if (report_memory) {
+    print_peak_memory();
+  }
+
+  return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void print_peak_memory() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    eprintf("Peak memory: %ld KiB\n", usage.ru_maxrss);
+  }
 }
 
 static void print_usage() {
-  puts("Usage: huff ifile [-c | -x] ofile\n"
+  puts("Usage: huff ifile [-c | -x | -g id] [-l] [-b size] [-m] [-p sec] [-B size] [-P] [-w] [-a] [-t] [-A] [-R]\n"
+      "            [-D] [--queue-depth n] [--workers n] [--numa] [-M] ofile\n"
+      "       huff --serve socket [--workers n] [--numa] [--cache-tables] [-l] [-b size]\n"
+      "       huff --estimate [--sample n] [--workers n] file...\n"
       "ifile - input file\n"
       "ofile - output file\n"
       "-c - compress ifile to ofile\n"
-      "-x - decompress ifile to ofile\n");
+      "-x - decompress ifile to ofile\n"
+      "-g - decode record id of record archive ifile to ofile\n"
+      "-l - low memory mode, use 1 MiB buffers\n"
+      "-b - size of buffers in bytes (64 KiB .. 200 MiB)\n"
+      "-m - print peak memory usage\n"
+      "-p - print progress and throughput every sec seconds\n"
+      "-B - write block archive with blocks of size bytes\n"
+      "-P - measure phases with hardware performance counters\n"
+      "-w - also code blocks as 16 bit little endian symbols\n"
+      "-a - split blocks where statistics change, -B is largest block (8 MiB)\n"
+      "-t - code blocks after move-to-front and zero run transform if smaller\n"
+      "-A - append blocks of ifile to block archive ofile\n"
+      "-R - write each line as record that -g can decode alone\n"
+      "-D - read and write with io_uring and O_DIRECT if file system allows\n"
+      "-M - decode straight to memory mapped ofile\n"
+      "--serve - run daemon on unix socket, buffers are 1 MiB unless set\n"
+      "--workers - count of daemon workers (default 4), estimate threads or\n"
+      "            threads of -c without blocks and records (default 1)\n"
+      "--cache-tables - reuse decode tables of repeated trees in daemon\n"
+      "--estimate - print compressed size, ratio and entropy, write nothing\n"
+      "--sample - count one 64 KiB part of every n parts\n"
+      "--queue-depth - requests in flight per buffer with -D (default 8)\n"
+      "--numa - pin workers to CPUs of NUMA nodes and keep their buffers on\n"
+      "         their node, -P prints workers of each node\n");
 }
@@ -0,0 +1,95 @@
+#include "mtf.h"
+
+static void mtf_init(uint8_t list[]) {
+  uint32_t i;
+  for (i = 0; i < MTF_SYMBOLS; i++) {
+    list[i] = i;
+  }
+}
+
+int64_t mtf_rle_encode(const uint8_t *src, uint64_t size, uint8_t *dst,
+                       uint64_t capacity) {
+  uint8_t list[MTF_SYMBOLS];
+  uint64_t position = 0;
+  uint32_t run = 0;
+  uint32_t extra = 0;
+  uint64_t i;
+
+  mtf_init(list);
+  for (i = 0; i < size; i++) {
+    uint8_t ch = src[i];
+    if (ch == list[0]) {
+      if (run < MTF_RUN_THRESHOLD) {
+        if (position == capacity) {
+          return -1;
+        }
+        dst[position++] = 0;
+        run++;
+      } else if (++extra == MTF_RUN_MAX) {
+        if (position == capacity) {
+          return -1;
+        }
+        dst[position++] = extra;
+        run = 0;
+        extra = 0;
+      }
+      continue;
+    }
+
+    uint32_t index = (const uint8_t *)memchr(list, ch, MTF_SYMBOLS) - list;
+    memmove(&list[1], list, index);
+    list[0] = ch;
+    if (position + 2 > capacity) {
+      return -1;
+    }
+    if (run == MTF_RUN_THRESHOLD) {
+      dst[position++] = extra;
+    }
+    dst[position++] = index;
+    run = 0;
+    extra = 0;
+  }
+  if (run == MTF_RUN_THRESHOLD) {
+    if (position == capacity) {
+      return -1;
+    }
+    dst[position++] = extra;
+  }
+  return position;
+}
+
+int64_t mtf_rle_decode(const uint8_t *src, uint64_t size, uint8_t *dst,
+                       uint64_t capacity) {
+  uint8_t list[MTF_SYMBOLS];
+  uint64_t position = 0;
+  uint32_t run = 0;
+  uint64_t i;
+
+  mtf_init(list);
+  for (i = 0; i < size; i++) {
+    uint8_t index = src[i];
+    if (run == MTF_RUN_THRESHOLD) {
+      if (position + index > capacity) {
+        return -1;
+      }
+      memset(&dst[position], list[0], index);
+      position += index;
+      run = 0;
+      continue;
+    }
+    if (position == capacity) {
+      return -1;
+    }
+    if (!index) {
+      dst[position++] = list[0];
+      run++;
+      continue;
+    }
+    uint8_t ch = list[index];
+    memmove(&list[1], list, index);
+    list[0] = ch;
+    dst[position++] = ch;
+    run = 0;
+  }
+  return position;
+}
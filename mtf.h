@@ -0,0 +1,52 @@
+/**
+ * @file       mtf.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for move-to-front and zero run transform.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef MTF_H_
+#define MTF_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "error_handler.h"
+
+
+#define MTF_SYMBOLS 256                     /// Size of symbol list
+#define MTF_RUN_THRESHOLD 4                 /// Zeros before run count byte
+#define MTF_RUN_MAX 255                     /// Largest run count byte
+
+/**
+ * @brief Move-to-front then zero run encoding
+ * @details Each byte is replaced by its position in list of recently used
+ * bytes, so repeats become zeros. After MTF_RUN_THRESHOLD zeros one byte
+ * with count of following zeros is written. Symbol list is searched with
+ * memchr and moved with memmove, both are vectorized in libc.
+ *
+ * @param src Data to transform
+ * @param size Size of data
+ * @param dst Memory for transformed data
+ * @param capacity Size of dst
+ * @return Size of transformed data or -1 if it does not fit to capacity
+ */
+int64_t mtf_rle_encode(const uint8_t *src, uint64_t size, uint8_t *dst,
+                       uint64_t capacity);
+
+/**
+ * @brief Inverse of mtf_rle_encode
+ *
+ * @param src Transformed data
+ * @param size Size of transformed data
+ * @param dst Memory for restored data
+ * @param capacity Size of dst
+ * @return Size of restored data or -1 if it does not fit to capacity
+ */
+int64_t mtf_rle_decode(const uint8_t *src, uint64_t size, uint8_t *dst,
+                       uint64_t capacity);
+
+#endif /* MTF_H_ */
@@ -0,0 +1,112 @@
+#include "numa.h"
+
+/*
+ * Add CPUs of cpulist like "0-3,8-11" that process may use to node.
+ */
+static void numa_add_cpulist(numa_topology *topo, const char *list,
+                             uint32_t node, const cpu_set_t *allowed) {
+  while (*list && *list != '\n') {
+    char *end;
+    unsigned long first = strtoul(list, &end, 10);
+    unsigned long last = first;
+    if (end == list) {
+      return;
+    }
+    if (*end == '-') {
+      list = end + 1;
+      last = strtoul(list, &end, 10);
+    }
+    for (; first <= last && first < CPU_SETSIZE &&
+         topo->cpus_count < NUMA_MAX_CPUS; first++) {
+      if (CPU_ISSET(first, allowed)) {
+        topo->cpus[topo->cpus_count] = first;
+        topo->nodes[topo->cpus_count] = node;
+        topo->cpus_count++;
+      }
+    }
+    list = *end == ',' ? end + 1 : end;
+  }
+}
+
+int32_t numa_topology_init(numa_topology *topo) {
+  char path[sizeof(NUMA_NODE_PATH) + 32];
+  char list[NUMA_CPULIST_SIZE];
+  cpu_set_t allowed;
+  uint32_t node;
+  uint32_t cpu;
+
+  memset(topo, 0, sizeof(*topo));
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+    ERROR_GOTO();
+  }
+
+  for (node = 0; node < NUMA_MAX_NODES; node++) {
+    snprintf(path, sizeof(path), NUMA_NODE_PATH "/node%u/cpulist", node);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+      continue;
+    }
+    uint32_t before = topo->cpus_count;
+    if (fgets(list, sizeof(list), file)) {
+      numa_add_cpulist(topo, list, topo->nodes_count, &allowed);
+    }
+    fclose(file);
+    if (topo->cpus_count > before) {
+      topo->nodes_count++;
+    }
+  }
+
+  if (!topo->cpus_count) {
+    for (cpu = 0; cpu < CPU_SETSIZE && topo->cpus_count < NUMA_MAX_CPUS;
+         cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        topo->cpus[topo->cpus_count] = cpu;
+        topo->nodes[topo->cpus_count] = 0;
+        topo->cpus_count++;
+      }
+    }
+    topo->nodes_count = 1;
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static uint32_t numa_worker_cpu(const numa_topology *topo, uint32_t worker,
+                                uint32_t workers_count) {
+  if (workers_count <= topo->cpus_count) {
+    return (uint64_t)worker * topo->cpus_count / workers_count;
+  }
+  return worker % topo->cpus_count;
+}
+
+int32_t numa_bind_worker(const numa_topology *topo, uint32_t worker,
+                         uint32_t workers_count) {
+  uint32_t index = numa_worker_cpu(topo, worker, workers_count);
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(topo->cpus[index], &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+    eprintf("Cannot pin worker %u to cpu %u\n", worker, topo->cpus[index]);
+    return -1;
+  }
+  return topo->nodes[index];
+}
+
+void numa_report(const numa_topology *topo, uint32_t workers_count) {
+  uint32_t cpus[NUMA_MAX_NODES] = {0};
+  uint32_t workers[NUMA_MAX_NODES] = {0};
+  uint32_t i;
+
+  for (i = 0; i < topo->cpus_count; i++) {
+    cpus[topo->nodes[i]]++;
+  }
+  for (i = 0; i < workers_count; i++) {
+    workers[topo->nodes[numa_worker_cpu(topo, i, workers_count)]]++;
+  }
+  for (i = 0; i < topo->nodes_count; i++) {
+    eprintf("numa node %u: %u cpus, %u workers\n", i, cpus[i], workers[i]);
+  }
+}
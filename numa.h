@@ -0,0 +1,80 @@
+/**
+ * @file       numa.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for placing workers on NUMA nodes.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef NUMA_H_
+#define NUMA_H_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "error_handler.h"
+
+
+#define NUMA_NODE_PATH "/sys/devices/system/node"  /// Nodes of kernel
+#define NUMA_MAX_NODES 64                   /// Largest count of nodes
+#define NUMA_MAX_CPUS 1024                  /// Largest count of CPUs
+#define NUMA_CPULIST_SIZE 4096              /// Longest cpulist of node
+
+ /**
+  * @struct numa_topology
+  * @brief This struct store CPUs that process may use grouped by node
+  * @details CPUs are ordered by node, so contiguous range of them is on
+  * one node or on few neighbour nodes. Memory is placed on node of thread
+  * that touches it first, so worker that allocates and fills its buffers
+  * after it is pinned gets them on its own node.
+  */
+typedef struct numa_topology {
+  uint32_t nodes_count;             /**< Nodes with allowed CPUs */
+  uint32_t cpus_count;              /**< Allowed CPUs */
+  uint16_t cpus[NUMA_MAX_CPUS];       /**< Allowed CPUs ordered by node */
+  uint16_t nodes[NUMA_MAX_CPUS];      /**< Node of each of cpus, nodes without
+                                         allowed CPUs are not counted */
+} numa_topology;
+
+/**
+ * @brief Read nodes and CPUs of process
+ * @details Nodes are read from NUMA_NODE_PATH, CPUs are limited to
+ * affinity of process. Without node information all CPUs are one node.
+ *
+ * @param topo Topology to fill
+ * @return 0 on success and -1 if faild
+ */
+int32_t numa_topology_init(numa_topology *topo);
+
+/**
+ * @brief Pin calling thread to CPU of worker
+ * @details Workers are spread evenly over cpus, so workers with near
+ * numbers share node. If there are more workers than CPUs they wrap.
+ *
+ * @param topo Topology
+ * @param worker Number of worker
+ * @param workers_count Count of workers
+ * @return Node of worker or -1 if thread cannot be pinned
+ */
+int32_t numa_bind_worker(const numa_topology *topo, uint32_t worker,
+                         uint32_t workers_count);
+
+/**
+ * @brief Print CPUs and workers of each node to stderr
+ *
+ * @param topo Topology
+ * @param workers_count Count of workers
+ */
+void numa_report(const numa_topology *topo, uint32_t workers_count);
+
+#endif /* NUMA_H_ */
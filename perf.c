@@ -0,0 +1,129 @@
+#include "perf.h"
+
+static const char *perf_counter_names[PERF_COUNTERS] = {
+  "cycles", "instr", "br-miss", "L1d-miss", "LLC-miss"
+};
+
+static double perf_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+static int32_t perf_open(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#define PERF_CACHE_MISS(cache)                                                 \
+      ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                          \
+       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+#endif
+
+void perf_init(perf_t *perf) {
+  uint32_t i;
+  memset(perf, 0, sizeof(*perf));
+  for (i = 0; i < PERF_COUNTERS; i++) {
+    perf->fds[i] = -1;
+  }
+#ifdef __linux__
+  perf->fds[PERF_CYCLES] = perf_open(PERF_TYPE_HARDWARE,
+                                     PERF_COUNT_HW_CPU_CYCLES);
+  perf->fds[PERF_INSTRUCTIONS] = perf_open(PERF_TYPE_HARDWARE,
+                                           PERF_COUNT_HW_INSTRUCTIONS);
+  perf->fds[PERF_BRANCH_MISSES] = perf_open(PERF_TYPE_HARDWARE,
+                                            PERF_COUNT_HW_BRANCH_MISSES);
+  perf->fds[PERF_L1D_MISSES] = perf_open(PERF_TYPE_HW_CACHE,
+                                   PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D));
+  perf->fds[PERF_LLC_MISSES] = perf_open(PERF_TYPE_HW_CACHE,
+                                   PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL));
+#endif
+  for (i = 0; i < PERF_COUNTERS; i++) {
+    perf->available |= perf->fds[i] >= 0;
+  }
+  if (!perf->available) {
+    eprintf("Performance counters are not available, only time is measured\n");
+  }
+}
+
+void perf_destroy(perf_t *perf) {
+  uint32_t i;
+  for (i = 0; i < PERF_COUNTERS; i++) {
+    if (perf->fds[i] >= 0) {
+      close(perf->fds[i]);
+      perf->fds[i] = -1;
+    }
+  }
+}
+
+void perf_begin(perf_t *perf, const char *name) {
+  if (perf->phases_count == PERF_MAX_PHASES) {
+    return;
+  }
+  perf->phases[perf->phases_count].name = name;
+#ifdef __linux__
+  uint32_t i;
+  for (i = 0; i < PERF_COUNTERS; i++) {
+    if (perf->fds[i] >= 0) {
+      ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+  perf->start = perf_now();
+}
+
+void perf_end(perf_t *perf, uint64_t bytes) {
+  uint32_t i;
+  if (perf->phases_count == PERF_MAX_PHASES) {
+    return;
+  }
+  perf_phase *phase = &perf->phases[perf->phases_count++];
+  phase->seconds = perf_now() - perf->start;
+  phase->bytes = bytes;
+  for (i = 0; i < PERF_COUNTERS; i++) {
+    if (perf->fds[i] < 0) {
+      continue;
+    }
+#ifdef __linux__
+    ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    if (read(perf->fds[i], &phase->values[i], sizeof(phase->values[i])) !=
+        sizeof(phase->values[i])) {
+      phase->values[i] = 0;
+    }
+  }
+}
+
+void perf_report(perf_t *perf) {
+  uint32_t i;
+  uint32_t j;
+  eprintf("%-16s %12s %10s", "phase", "bytes", "MB/s");
+  for (j = 0; j < PERF_COUNTERS; j++) {
+    eprintf(" %10s", perf_counter_names[j]);
+  }
+  eprintf("  (counters per byte)\n");
+  for (i = 0; i < perf->phases_count; i++) {
+    perf_phase *phase = &perf->phases[i];
+    double bytes = phase->bytes ? phase->bytes : 1;
+    eprintf("%-16s %12llu %10.1f", phase->name,
+            (unsigned long long)phase->bytes,
+            phase->seconds > 0 ? phase->bytes / 1e6 / phase->seconds : 0);
+    for (j = 0; j < PERF_COUNTERS; j++) {
+      if (perf->fds[j] >= 0) {
+        eprintf(" %10.4f", phase->values[j] / bytes);
+      } else {
+        eprintf(" %10s", "n/a");
+      }
+    }
+    eprintf("\n");
+  }
+}
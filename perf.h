@@ -0,0 +1,124 @@
+/**
+ * @file       perf.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for hardware performance counters.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "error_handler.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#endif
+
+
+#define PERF_MAX_PHASES 8                   /// Phases in one report
+
+typedef enum {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_BRANCH_MISSES,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_COUNTERS                     /**< Count of counters */
+} perf_counter_t;
+
+ /**
+  * @struct perf_phase
+  * @brief This struct store counters of one phase
+  */
+typedef struct perf_phase {
+  const char *name;                 /**< Name of phase */
+  uint64_t bytes;                   /**< Bytes processed in phase */
+  double   seconds;                 /**< Wall time of phase */
+  uint64_t values[PERF_COUNTERS];   /**< Counter values */
+} perf_phase;
+
+ /**
+  * @struct perf_t
+  * @brief This struct store opened counters and measured phases
+  */
+typedef struct perf_t {
+  int32_t    fds[PERF_COUNTERS];    /**< Counter descriptors, -1 if absent */
+  bool       available;             /**< At least one counter opened */
+  uint32_t   phases_count;          /**< Count of measured phases */
+  double     start;                 /**< Start time of current phase */
+  perf_phase phases[PERF_MAX_PHASES]; /**< Measured phases */
+} perf_t;
+
+/**
+ * @brief Open counters for this thread
+ * @details Counters that can not be opened are skipped, phases are still
+ * timed if no counter is available.
+ *
+ * @param perf Counters
+ */
+void perf_init(perf_t *perf);
+
+/**
+ * @brief Close counters
+ *
+ * @param perf Counters
+ */
+void perf_destroy(perf_t *perf);
+
+/**
+ * @brief Reset and start counters for new phase
+ *
+ * @param perf Counters
+ * @param name Name of phase
+ */
+void perf_begin(perf_t *perf, const char *name);
+
+/**
+ * @brief Stop counters and store them in current phase
+ *
+ * @param perf Counters
+ * @param bytes Bytes processed in phase
+ */
+void perf_end(perf_t *perf, uint64_t bytes);
+
+/**
+ * @brief Print counters of each phase per byte
+ *
+ * @param perf Counters
+ */
+void perf_report(perf_t *perf);
+
+
+/**
+ * Macros to begin phase if profiling is enabled.
+ */
+#define PERF_BEGIN(perf, name)                                                 \
+      ({                                                                       \
+        if (perf) {                                                            \
+          perf_begin(perf, name);                                              \
+        }                                                                      \
+      })
+
+/**
+ * Macros to end phase if profiling is enabled.
+ */
+#define PERF_END(perf, bytes)                                                  \
+      ({                                                                       \
+        if (perf) {                                                            \
+          perf_end(perf, bytes);                                               \
+        }                                                                      \
+      })
+
+#endif /* PERF_H_ */
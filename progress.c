@@ -0,0 +1,44 @@
+#include "progress.h"
+
+#define BYTES_IN_MB (1000.0 * 1000.0)
+
+static double progress_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void progress_print(progress_t *progress, double now) {
+  double elapsed = now - progress->start;
+  double speed = elapsed > 0 ? progress->processed / BYTES_IN_MB / elapsed : 0;
+  if (progress->total) {
+    eprintf("%s: %llu / %llu bytes (%.1f%%), %.1f MB/s\n", progress->label,
+            (unsigned long long)progress->processed,
+            (unsigned long long)progress->total,
+            100.0 * progress->processed / progress->total, speed);
+  } else {
+    eprintf("%s: %llu bytes, %.1f MB/s\n", progress->label,
+            (unsigned long long)progress->processed, speed);
+  }
+}
+
+void progress_start(progress_t *progress, const char *label, uint64_t total) {
+  progress->label = label;
+  progress->total = total;
+  progress->processed = 0;
+  progress->start = progress_now();
+  progress->last = progress->start;
+}
+
+void progress_update(progress_t *progress, uint64_t bytes) {
+  progress->processed += bytes;
+  double now = progress_now();
+  if (now - progress->last >= progress->interval) {
+    progress->last = now;
+    progress_print(progress, now);
+  }
+}
+
+void progress_finish(progress_t *progress) {
+  progress_print(progress, progress_now());
+}
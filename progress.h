@@ -0,0 +1,93 @@
+/**
+ * @file       progress.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for reporting progress of long jobs.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef PROGRESS_H_
+#define PROGRESS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "error_handler.h"
+
+
+ /**
+  * @struct progress_t
+  * @brief This struct store state of progress reporter
+  */
+typedef struct progress_t {
+  const char *label;                /**< Name of phase that is reported */
+  uint64_t total;                   /**< Expected count of bytes, 0 if unknown */
+  uint64_t processed;               /**< Count of processed bytes */
+  double   interval;                /**< Seconds between two reports */
+  double   start;                   /**< Time of phase start */
+  double   last;                    /**< Time of last report */
+} progress_t;
+
+/**
+ * @brief Start new phase
+ * @details Reset counters and remember start time of phase.
+ *
+ * @param progress Progress reporter
+ * @param label Name of phase
+ * @param total Expected count of bytes, 0 if unknown
+ */
+void progress_start(progress_t *progress, const char *label, uint64_t total);
+
+/**
+ * @brief Add processed bytes
+ * @details Print processed bytes and throughput if interval elapsed since
+ * last report. Must be called once per buffer, not per symbol.
+ *
+ * @param progress Progress reporter
+ * @param bytes Count of bytes processed since last call
+ */
+void progress_update(progress_t *progress, uint64_t bytes);
+
+/**
+ * @brief Finish phase
+ * @details Print final count of bytes and average throughput.
+ *
+ * @param progress Progress reporter
+ */
+void progress_finish(progress_t *progress);
+
+
+/**
+ * Macros to update progress if reporter is enabled.
+ */
+#define PROGRESS_UPDATE(progress, bytes)                                       \
+      ({                                                                       \
+        if (progress) {                                                        \
+          progress_update(progress, bytes);                                    \
+        }                                                                      \
+      })
+
+/**
+ * Macros to start phase if reporter is enabled.
+ */
+#define PROGRESS_START(progress, label, total)                                 \
+      ({                                                                       \
+        if (progress) {                                                        \
+          progress_start(progress, label, total);                              \
+        }                                                                      \
+      })
+
+/**
+ * Macros to finish phase if reporter is enabled.
+ */
+#define PROGRESS_FINISH(progress)                                              \
+      ({                                                                       \
+        if (progress) {                                                        \
+          progress_finish(progress);                                           \
+        }                                                                      \
+      })
+
+#endif /* PROGRESS_H_ */
@@ -0,0 +1,352 @@
+#include "record.h"
+
+#define RECORD_PUT_LE64(bytes, value)                                          \
+      ({                                                                       \
+        uint64_t tmp_value = htole64(value);                                   \
+        memcpy(bytes, &tmp_value, sizeof(tmp_value));                          \
+      })
+
+#define RECORD_PUT_LE32(bytes, value)                                          \
+      ({                                                                       \
+        uint32_t tmp_value = htole32(value);                                   \
+        memcpy(bytes, &tmp_value, sizeof(tmp_value));                          \
+      })
+
+#define RECORD_GET_LE64(bytes)                                                 \
+      ({                                                                       \
+        uint64_t tmp_value;                                                    \
+        memcpy(&tmp_value, bytes, sizeof(tmp_value));                          \
+        le64toh(tmp_value);                                                    \
+      })
+
+#define RECORD_GET_LE32(bytes)                                                 \
+      ({                                                                       \
+        uint32_t tmp_value;                                                    \
+        memcpy(&tmp_value, bytes, sizeof(tmp_value));                          \
+        le32toh(tmp_value);                                                    \
+      })
+
+static int32_t record_list_add(record_list *list, uint64_t bit_offset,
+                               uint64_t size) {
+  if (size > UINT32_MAX) {
+    eprintf("Record is too big\n");
+    ERROR_GOTO();
+  }
+  if (list->count == list->capacity) {
+    uint64_t capacity = list->capacity ? list->capacity * 2 : 1024;
+    record_entry *grown = realloc(list->entries, capacity * sizeof(*grown));
+    if (!grown) {
+      ERROR_GOTO();
+    }
+    list->entries = grown;
+    list->capacity = capacity;
+  }
+  list->entries[list->count].bit_offset = bit_offset;
+  list->entries[list->count].size = size;
+  list->count++;
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Append codes of data and count their bits.
+ */
+static int32_t record_codes_append(huff_code *hnc[], const uint8_t *data,
+                                   uint64_t size, buffer_t *buff_out,
+                                   uint64_t *bits) {
+  uint64_t count = 0;
+  uint64_t i;
+  for (i = 0; i < size; i++) {
+    huff_code *hc = hnc[data[i]];
+    BUFFER_APPEND_HUFF_CODE(buff_out, hc);
+    count += hc->numbits;
+  }
+  *bits += count;
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int32_t record_write_index(const record_list *list, uint64_t raw_size,
+                                  uint64_t index_offset, int fildes) {
+  uint64_t index_size = list->count * RECORD_ENTRY_SIZE;
+  uint8_t trailer[RECORD_TRAILER_SIZE];
+  uint8_t *index = NULL;
+  uint64_t i;
+
+  index = MALLOC(index_size + 1);
+  for (i = 0; i < list->count; i++) {
+    RECORD_PUT_LE64(&index[i * RECORD_ENTRY_SIZE], list->entries[i].bit_offset);
+    RECORD_PUT_LE32(&index[i * RECORD_ENTRY_SIZE + 8], list->entries[i].size);
+  }
+  RECORD_PUT_LE64(&trailer[0], index_offset);
+  RECORD_PUT_LE64(&trailer[8], list->count);
+  RECORD_PUT_LE64(&trailer[16], raw_size);
+  RECORD_PUT_LE64(&trailer[24], RECORD_MAGIC);
+
+  WRITE(index, sizeof(*index), index_size, fildes);
+  WRITE(trailer, sizeof(*trailer), sizeof(trailer), fildes);
+  FREE(index);
+  return 0;
+_err:
+  ERROR_MSG();
+  FREE(index);
+  ERROR_RETURN(-1);
+}
+
+int32_t record_encode(buffer_t *buff_in, buffer_t *buff_out, uint8_t delimiter,
+                      progress_t *progress) {
+  huff_node *hnt[MAX_SYMBOLS] = {NULL};
+  huff_code *hnc[MAX_SYMBOLS] = {NULL};
+  record_list list = { NULL, 0, 0 };
+  uint64_t magic = htole64(RECORD_MAGIC);
+  uint64_t record_start = 0;
+  uint64_t record_bytes = 0;
+  uint64_t bits;
+  int32_t symbols_count = 0;
+
+  huff_nodes_init(hnt);
+  int64_t raw_size = clalculate_symbol_frequancy(hnt, buff_in, NULL);
+  if (raw_size < 0) {
+    ERROR_GOTO();
+  }
+  symbols_count = construct_tree(hnt);
+  BUFFER_REWIND(buff_in);
+
+  BUFFER_SKIP_EOF(buff_out);
+  write_tree(hnt[0], buff_out, hnc);
+  bits = buff_out->buffer_position * UINT64_BIT + buff_out->bit_position -
+         UINT64_BIT;
+
+  PROGRESS_START(progress, "encode", raw_size);
+  while (BUFFER_READ(buff_in) != NULL) {
+    const uint8_t *data = buff_in->buffer;
+    uint64_t left = buff_in->buffer_size;
+    while (left) {
+      const uint8_t *end = memchr(data, delimiter, left);
+      uint64_t size = end ? (uint64_t)(end - data) + 1 : left;
+      if (!record_bytes) {
+        record_start = bits;
+      }
+      if (record_codes_append(hnc, data, size, buff_out, &bits) < 0) {
+        ERROR_GOTO();
+      }
+      record_bytes += size;
+      if (end) {
+        if (record_list_add(&list, record_start, record_bytes) < 0) {
+          ERROR_GOTO();
+        }
+        record_bytes = 0;
+      }
+      data += size;
+      left -= size;
+    }
+    PROGRESS_UPDATE(progress, buff_in->buffer_size);
+  }
+  if (record_bytes && record_list_add(&list, record_start, record_bytes) < 0) {
+    ERROR_GOTO();
+  }
+  PROGRESS_FINISH(progress);
+
+  /* Pad codes to byte, so index starts at byte and nothing is lost. */
+  uint64_t pad_bits = 0;
+  uint32_t pad = (CHAR_BIT - buff_out->bit_position % CHAR_BIT) % CHAR_BIT;
+  BUFFER_APPEND_BITS(buff_out, pad_bits, pad);
+  BUFFER_WRITE_END(buff_out);
+
+  if (record_write_index(&list, raw_size,
+                         sizeof(magic) + (bits + pad) / CHAR_BIT,
+                         buff_out->file) < 0) {
+    ERROR_GOTO();
+  }
+  BUFFER_REWIND(buff_out);
+  WRITE(&magic, sizeof(magic), 1, buff_out->file);
+
+  FREE(list.entries);
+  huff_nodes_destroy(hnt, symbols_count);
+  huff_codes_destroy(hnc);
+  return 0;
+_err:
+  ERROR_MSG();
+  FREE(list.entries);
+  huff_nodes_destroy(hnt, symbols_count);
+  huff_codes_destroy(hnc);
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Set memory buffer over codes of archive at bit_offset.
+ */
+static int32_t record_view(const record_reader *rr, uint64_t bit_offset,
+                           buffer_t *view) {
+  memset(view, 0, sizeof(*view));
+  view->buffer = &rr->map[sizeof(uint64_t)];
+  view->buffer_size = rr->codes_size;
+  view->buffer_capacity = rr->codes_size;
+  view->buffer_position = bit_offset / CHAR_BIT;
+  view->bit_position = CHAR_BIT - bit_offset % CHAR_BIT;
+  view->file = -1;
+  BUFFER_BITS_INIT(view);
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+record_reader* record_open(int fildes) {
+  record_reader *rr = NULL;
+  buffer_t view;
+  struct stat st;
+
+  rr = CALLOC(1, sizeof(*rr));
+  rr->map = MAP_FAILED;
+  if (fstat(fildes, &st) < 0) {
+    ERROR_GOTO();
+  }
+  if ((uint64_t)st.st_size < sizeof(uint64_t) + RECORD_TRAILER_SIZE) {
+    eprintf("Corrupted record archive\n");
+    ERROR_GOTO();
+  }
+  rr->map_size = st.st_size;
+  rr->map = mmap(NULL, rr->map_size, PROT_READ, MAP_PRIVATE, fildes, 0);
+  if (rr->map == MAP_FAILED) {
+    ERROR_GOTO();
+  }
+
+  const uint8_t *trailer = &rr->map[rr->map_size - RECORD_TRAILER_SIZE];
+  uint64_t index_offset = RECORD_GET_LE64(&trailer[0]);
+  rr->count = RECORD_GET_LE64(&trailer[8]);
+  rr->raw_size = RECORD_GET_LE64(&trailer[16]);
+  if (RECORD_GET_LE64(rr->map) != RECORD_MAGIC ||
+      RECORD_GET_LE64(&trailer[24]) != RECORD_MAGIC ||
+      index_offset < sizeof(uint64_t) ||
+      rr->count > rr->map_size / RECORD_ENTRY_SIZE ||
+      index_offset + rr->count * RECORD_ENTRY_SIZE + RECORD_TRAILER_SIZE !=
+      rr->map_size) {
+    eprintf("Corrupted record archive\n");
+    ERROR_GOTO();
+  }
+  rr->index = &rr->map[index_offset];
+  rr->codes_size = index_offset - sizeof(uint64_t);
+
+  memset(&view, 0, sizeof(view));
+  view.buffer = &rr->map[sizeof(uint64_t)];
+  view.buffer_size = rr->codes_size;
+  view.bit_position = CHAR_BIT;
+  view.file = -1;
+  if (read_tree(&rr->tree, &view) < 0) {
+    ERROR_GOTO();
+  }
+  rr->table = huff_table_init(rr->tree, huff_table_choose_symbols(rr->tree));
+  if (!rr->table) {
+    ERROR_GOTO();
+  }
+  return rr;
+_err:
+  ERROR_MSG();
+  if (rr) {
+    record_close(rr);
+  }
+  ERROR_RETURN(NULL);
+}
+
+record_reader* record_close(record_reader *rr) {
+  huff_table_destroy(rr->table);
+  huff_tree_destroy(rr->tree);
+  if (rr->map != MAP_FAILED) {
+    munmap(rr->map, rr->map_size);
+  }
+  FREE(rr);
+  return rr;
+}
+
+int64_t record_size(const record_reader *rr, uint64_t record_id) {
+  if (record_id >= rr->count) {
+    return -1;
+  }
+  return RECORD_GET_LE32(&rr->index[record_id * RECORD_ENTRY_SIZE + 8]);
+}
+
+int64_t record_get(const record_reader *rr, uint64_t record_id, uint8_t *out,
+                   uint64_t capacity) {
+  const uint8_t *entry;
+  buffer_t view;
+
+  if (record_id >= rr->count) {
+    eprintf("No record %llu\n", (unsigned long long)record_id);
+    ERROR_GOTO();
+  }
+  entry = &rr->index[record_id * RECORD_ENTRY_SIZE];
+  uint64_t bit_offset = RECORD_GET_LE64(entry);
+  uint32_t size = RECORD_GET_LE32(&entry[8]);
+  if (size > capacity || bit_offset > rr->codes_size * CHAR_BIT) {
+    eprintf("Record %llu does not fit\n", (unsigned long long)record_id);
+    ERROR_GOTO();
+  }
+  if (record_view(rr, bit_offset, &view) < 0 ||
+      huff_table_decode(rr->table, &view, out, size) < 0) {
+    ERROR_GOTO();
+  }
+  return size;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+int32_t record_decode(buffer_t *buff_in, buffer_t *buff_out, bool map_output,
+                      progress_t *progress) {
+  record_reader *rr = record_open(buff_in->file);
+  uint8_t *map = NULL;
+  buffer_t view;
+  uint64_t left = 0;
+  uint64_t i;
+
+  if (!rr) {
+    ERROR_GOTO();
+  }
+  for (i = 0; i < rr->count; i++) {
+    left += record_size(rr, i);
+  }
+  if (left != rr->raw_size) {
+    eprintf("Corrupted record archive\n");
+    ERROR_GOTO();
+  }
+  if (left && record_view(rr, RECORD_GET_LE64(rr->index), &view) < 0) {
+    ERROR_GOTO();
+  }
+  if (map_output) {
+    map = buffer_map(buff_out, left);
+  }
+  while (left) {
+    uint64_t count = left < buff_out->buffer_capacity ?
+                     left : buff_out->buffer_capacity;
+    uint8_t *out = map ? &map[rr->raw_size - left] : buff_out->buffer;
+    if (huff_table_decode(rr->table, &view, out, count) < 0) {
+      ERROR_GOTO();
+    }
+    if (!map) {
+      WRITE(out, sizeof(*out), count, buff_out->file);
+    }
+    PROGRESS_UPDATE(progress, count);
+    left -= count;
+  }
+  if (map && buffer_unmap(buff_out, map, rr->raw_size) < 0) {
+    map = NULL;
+    ERROR_GOTO();
+  }
+
+  record_close(rr);
+  return 0;
+_err:
+  ERROR_MSG();
+  if (map) {
+    munmap(map, rr->raw_size);
+  }
+  if (rr) {
+    record_close(rr);
+  }
+  ERROR_RETURN(-1);
+}
@@ -0,0 +1,147 @@
+/**
+ * @file       record.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for record archives with random access.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include "error_handler.h"
+#include "macros.h"
+#include "buffer.h"
+#include "eof.h"
+#include "huff_nodes.h"
+#include "huff_codes.h"
+#include "huff_table.h"
+#include "progress.h"
+
+
+#define RECORD_MAGIC 0x0a1a0a0d52464889ULL  /// "\x89HFR\r\n\x1a\n" as LE
+#define RECORD_DELIMITER '\n'               /// End of record in input
+#define RECORD_ENTRY_SIZE 12                /// Bit offset and size
+#define RECORD_TRAILER_SIZE 32              /// Fields after index
+
+/*
+ * Record archive, little endian:
+ *   RECORD_MAGIC u64
+ *   tree and codes of all records as one bitstream, padded to byte
+ *   index of count entries: bit offset u64, size u32
+ *   index offset u64, count u64, raw size u64, RECORD_MAGIC u64
+ * Bit offsets are counted from end of magic, all records share one tree.
+ */
+
+ /**
+  * @struct record_entry
+  * @brief This struct store position of one record
+  */
+typedef struct record_entry {
+  uint64_t bit_offset;              /**< First bit of record codes */
+  uint32_t size;                    /**< Size of decoded record */
+} record_entry;
+
+ /**
+  * @struct record_list
+  * @brief This struct store entries of written records
+  */
+typedef struct record_list {
+  record_entry *entries;            /**< Written records */
+  uint64_t count;                   /**< Count of entries */
+  uint64_t capacity;                /**< Allocated entries */
+} record_list;
+
+ /**
+  * @struct record_reader
+  * @brief This struct store mapped record archive and its decode table
+  * @details Reader is not changed by record_get, so many threads can get
+  * records from one reader.
+  */
+typedef struct record_reader {
+  uint8_t *map;                     /**< Mapped archive */
+  uint64_t map_size;                /**< Size of archive */
+  uint64_t codes_size;              /**< Bytes of tree and codes */
+  const uint8_t *index;             /**< Entries in archive */
+  uint64_t count;                   /**< Count of records */
+  uint64_t raw_size;                /**< Size of all records */
+  huff_node *tree;                  /**< Shared tree */
+  huff_table *table;                /**< Decode table of tree */
+} record_reader;
+
+/**
+ * @brief Encode input as record archive
+ * @details Input is split to records after each delimiter, last record
+ * may have no delimiter. Frequency of all input is counted first, then
+ * each record is coded with shared tree and its bit offset is stored.
+ * Output file must be seekable.
+ *
+ * @param buff_in Input buffer
+ * @param buff_out Output buffer
+ * @param delimiter Last byte of each record
+ * @param progress Progress reporter or NULL
+ * @return 0 on success and -1 if faild
+ */
+int32_t record_encode(buffer_t *buff_in, buffer_t *buff_out, uint8_t delimiter,
+                      progress_t *progress);
+
+/**
+ * @brief Decode all records of archive
+ * @details Magic must be already read from input file, input must be
+ * mappable.
+ *
+ * @param buff_in Input buffer
+ * @param buff_out Output buffer
+ * @param map_output Decode straight to mapped output file if it allows
+ * @param progress Progress reporter or NULL
+ * @return 0 on success and -1 if faild
+ */
+int32_t record_decode(buffer_t *buff_in, buffer_t *buff_out, bool map_output,
+                      progress_t *progress);
+
+/**
+ * @brief Map record archive and build its decode table
+ *
+ * @param fildes Opened archive, it can be closed after call
+ * @return Reader or NULL if failed
+ */
+record_reader* record_open(int fildes);
+
+/**
+ * @brief Unmap archive and free reader
+ *
+ * @param rr Reader
+ * @return NULL
+ */
+record_reader* record_close(record_reader *rr);
+
+/**
+ * @brief Get size of record
+ *
+ * @param rr Reader
+ * @param record_id Number of record from 0
+ * @return Size of record or -1 if there is no such record
+ */
+int64_t record_size(const record_reader *rr, uint64_t record_id);
+
+/**
+ * @brief Decode one record
+ * @details Only bits of record are decoded.
+ *
+ * @param rr Reader
+ * @param record_id Number of record from 0
+ * @param out Memory for record
+ * @param capacity Size of out
+ * @return Size of record or -1 if failed
+ */
+int64_t record_get(const record_reader *rr, uint64_t record_id, uint8_t *out,
+                   uint64_t capacity);
+
+#endif /* RECORD_H_ */
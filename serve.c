@@ -0,0 +1,555 @@
+#include "serve.h"
+
+static volatile sig_atomic_t serve_stop_signal = 0;
+
+static void serve_on_signal(int signum) {
+  (void)signum;
+  serve_stop_signal = 1;
+}
+
+static uint64_t serve_now_usec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int32_t serve_read_full(int fildes, uint8_t *dst, uint64_t size) {
+  while (size) {
+    ssize_t readed = READ(dst, sizeof(*dst), size, fildes);
+    if (!readed) {
+      eprintf("Unexpected end of request\n");
+      return -1;
+    }
+    dst += readed;
+    size -= readed;
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int32_t serve_write_full(int fildes, const uint8_t *src, uint64_t size) {
+  while (size) {
+    ssize_t writed = WRITE(src, sizeof(*src), size, fildes);
+    src += writed;
+    size -= writed;
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Receive request message and files passed with it.
+ * Return size of message, 0 if client closed connection.
+ */
+static ssize_t serve_recv_message(int conn, uint8_t message[], int fds[],
+                                  uint32_t *fds_count) {
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(SERVE_MAX_FDS * sizeof(int))];
+  } control;
+  struct iovec iov = { message, SERVE_MESSAGE_SIZE };
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control.buf,
+    .msg_controllen = sizeof(control.buf),
+  };
+  struct cmsghdr *cmsg;
+  ssize_t received;
+
+  *fds_count = 0;
+  received = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+  if (received <= 0) {
+    return received;
+  }
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      uint32_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      memcpy(&fds[*fds_count], CMSG_DATA(cmsg), count * sizeof(int));
+      *fds_count += count;
+    }
+  }
+  if (msg.msg_flags & MSG_CTRUNC) {
+    eprintf("Too many files in request\n");
+    while (*fds_count) {
+      close(fds[--*fds_count]);
+    }
+    return -1;
+  }
+
+  if (received < SERVE_MESSAGE_SIZE &&
+      serve_read_full(conn, &message[received],
+                      SERVE_MESSAGE_SIZE - received) < 0) {
+    return -1;
+  }
+  return SERVE_MESSAGE_SIZE;
+}
+
+static int32_t serve_copy_in(int conn, int fildes, buffer_t *scratch,
+                             uint64_t size) {
+  while (size) {
+    uint64_t chunk = size < scratch->buffer_capacity ? size : scratch->buffer_capacity;
+    if (serve_read_full(conn, scratch->buffer, chunk) < 0 ||
+        serve_write_full(fildes, scratch->buffer, chunk) < 0) {
+      return -1;
+    }
+    size -= chunk;
+  }
+  return 0;
+}
+
+static int32_t serve_send_file(int conn, int fildes, uint64_t size) {
+  off_t offset = 0;
+  while (size) {
+    ssize_t sent = sendfile(conn, fildes, &offset, size);
+    if (sent <= 0) {
+      eprintf("Cannot send response\n");
+      ERROR_GOTO();
+    }
+    size -= sent;
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static int32_t serve_memfd_reset(int fildes) {
+  if (ftruncate(fildes, 0) < 0 || lseek(fildes, 0, SEEK_SET) < 0) {
+    ERROR_GOTO();
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+/*
+ * Keep buffer if it already has capacity for size, else replace it.
+ */
+static int32_t serve_reserve(buffer_t **buff, uint64_t size) {
+  if (*buff && (*buff)->buffer_capacity == buffer_capacity_for(size)) {
+    return 0;
+  }
+  if (*buff) {
+    buffer_attach(*buff, -1);
+    buffer_destroy(*buff);
+  }
+  *buff = buffer_init_memory(size);
+  return *buff ? 0 : -1;
+}
+
+static uint64_t serve_percentile(const serve_metrics *metrics, uint32_t percent) {
+  uint64_t total = 0;
+  uint64_t seen = 0;
+  uint32_t i;
+  for (i = 0; i < SERVE_LATENCY_BUCKETS; i++) {
+    total += metrics->latency[i];
+  }
+  uint64_t rank = (total * percent + 99) / 100;
+  for (i = 0; i < SERVE_LATENCY_BUCKETS; i++) {
+    seen += metrics->latency[i];
+    if (seen && seen >= rank) {
+      return 1ULL << (i + 1);
+    }
+  }
+  return 0;
+}
+
+static uint32_t serve_format_metrics(serve_t *server, char *text) {
+  serve_metrics *metrics = &server->metrics;
+  uint32_t queue_depth;
+  int len;
+
+  pthread_mutex_lock(&server->lock);
+  queue_depth = server->queue_count;
+  pthread_mutex_unlock(&server->lock);
+
+  pthread_mutex_lock(&metrics->lock);
+  len = snprintf(text, SERVE_METRICS_SIZE,
+                 "workers %u\n"
+                 "requests %llu\n"
+                 "failures %llu\n"
+                 "bytes_in %llu\n"
+                 "bytes_out %llu\n"
+                 "queue_depth %u\n"
+                 "queue_max %u\n"
+                 "table_cache_hits %llu\n"
+                 "table_cache_misses %llu\n"
+                 "latency_p50_us %llu\n"
+                 "latency_p90_us %llu\n"
+                 "latency_p99_us %llu\n",
+                 server->workers_count,
+                 (unsigned long long)metrics->requests,
+                 (unsigned long long)metrics->failures,
+                 (unsigned long long)metrics->bytes_in,
+                 (unsigned long long)metrics->bytes_out,
+                 queue_depth, metrics->queue_max,
+                 (unsigned long long)metrics->table_hits,
+                 (unsigned long long)metrics->table_misses,
+                 (unsigned long long)serve_percentile(metrics, 50),
+                 (unsigned long long)serve_percentile(metrics, 90),
+                 (unsigned long long)serve_percentile(metrics, 99));
+  pthread_mutex_unlock(&metrics->lock);
+  return len < SERVE_METRICS_SIZE ? len : SERVE_METRICS_SIZE - 1;
+}
+
+static void serve_record(serve_t *server, int32_t status, uint64_t size_in,
+                         uint64_t size_out, uint64_t usec, uint64_t hits,
+                         uint64_t misses) {
+  serve_metrics *metrics = &server->metrics;
+  uint32_t bucket = UINT64_BIT - 1 - __builtin_clzll(usec | 1);
+  if (bucket >= SERVE_LATENCY_BUCKETS) {
+    bucket = SERVE_LATENCY_BUCKETS - 1;
+  }
+  pthread_mutex_lock(&metrics->lock);
+  metrics->requests++;
+  metrics->failures += status != 0;
+  metrics->bytes_in += size_in;
+  metrics->bytes_out += size_out;
+  metrics->table_hits += hits;
+  metrics->table_misses += misses;
+  metrics->latency[bucket]++;
+  pthread_mutex_unlock(&metrics->lock);
+}
+
+/*
+ * Run one compress or decompress request. Status of request is stored to
+ * status, -1 is returned only if connection is broken.
+ */
+static int32_t serve_process(serve_worker *worker, int conn,
+                             const serve_request *request, int fds[],
+                             uint32_t fds_count, int32_t *status) {
+  huff_params params = worker->server->params;
+  bool inline_io = !(request->flags & SERVE_FLAG_FDS);
+  uint8_t message[SERVE_MESSAGE_SIZE];
+  struct stat input_stat;
+  uint64_t size_out = 0;
+  int fd_in = -1;
+  int fd_out = -1;
+
+  *status = -1;
+  if (inline_io) {
+    fd_in = worker->memfd_in;
+    fd_out = worker->memfd_out;
+    if (serve_memfd_reset(fd_in) < 0 || serve_memfd_reset(fd_out) < 0 ||
+        serve_copy_in(conn, fd_in, worker->output, request->size) < 0 ||
+        lseek(fd_in, 0, SEEK_SET) < 0) {
+      return -1;
+    }
+  } else if (fds_count != SERVE_MAX_FDS) {
+    eprintf("Request needs input and output files\n");
+    goto respond;
+  } else {
+    fd_in = fds[0];
+    fd_out = fds[1];
+  }
+
+  params.block_size = request->block_size;
+  params.table_cache = worker->cache;
+  if (serve_reserve(&worker->input, request->op == SERVE_COMPRESS &&
+                    params.block_size ? params.block_size : params.buffer_size) < 0) {
+    goto respond;
+  }
+
+  buffer_attach(worker->input, fd_in);
+  buffer_attach(worker->output, fd_out);
+  if (request->op == SERVE_COMPRESS) {
+    *status = huffman_encode_buffers(worker->input, worker->output, &params);
+  } else if (request->op == SERVE_DECOMPRESS) {
+    *status = huffman_decode_buffers(worker->input, worker->output, &params);
+  } else {
+    eprintf("Unknown request %u\n", request->op);
+  }
+  buffer_attach(worker->input, -1);
+  buffer_attach(worker->output, -1);
+
+  if (!*status) {
+    off_t end = lseek(fd_out, 0, SEEK_END);
+    *status = end < 0 ? -1 : 0;
+    size_out = end < 0 ? 0 : end;
+  }
+
+respond:
+  if (*status) {
+    size_out = 0;
+  }
+  if (fstat(fd_in, &input_stat) == 0) {
+    worker->input_size = input_stat.st_size;
+  }
+  SERVE_RESPONSE_BUILD(message, *status, size_out);
+  if (serve_write_full(conn, message, SERVE_MESSAGE_SIZE) < 0) {
+    return -1;
+  }
+  if (inline_io && size_out && serve_send_file(conn, fd_out, size_out) < 0) {
+    return -1;
+  }
+  worker->output_size = size_out;
+  return 0;
+}
+
+static int32_t serve_metrics_reply(serve_t *server, int conn) {
+  char text[SERVE_METRICS_SIZE];
+  uint8_t message[SERVE_MESSAGE_SIZE];
+  uint32_t len = serve_format_metrics(server, text);
+  SERVE_RESPONSE_BUILD(message, 0, len);
+  if (serve_write_full(conn, message, SERVE_MESSAGE_SIZE) < 0 ||
+      serve_write_full(conn, (uint8_t *)text, len) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static void serve_connection(serve_worker *worker, int conn) {
+  uint8_t message[SERVE_MESSAGE_SIZE];
+  serve_request request;
+  int fds[SERVE_MAX_FDS];
+  uint32_t fds_count;
+  uint32_t i;
+
+  while (serve_recv_message(conn, message, fds, &fds_count) > 0) {
+    uint64_t start = serve_now_usec();
+    uint64_t hits = worker->cache ? worker->cache->hits : 0;
+    uint64_t misses = worker->cache ? worker->cache->misses : 0;
+    int32_t status;
+    int32_t ret;
+
+    SERVE_REQUEST_PARSE(request, message);
+    if (request.op == SERVE_METRICS) {
+      ret = serve_metrics_reply(worker->server, conn);
+    } else {
+      worker->input_size = 0;
+      worker->output_size = 0;
+      ret = serve_process(worker, conn, &request, fds, fds_count, &status);
+      serve_record(worker->server, ret < 0 ? -1 : status,
+                   worker->input_size, worker->output_size,
+                   serve_now_usec() - start,
+                   worker->cache ? worker->cache->hits - hits : 0,
+                   worker->cache ? worker->cache->misses - misses : 0);
+    }
+    for (i = 0; i < fds_count; i++) {
+      close(fds[i]);
+    }
+    if (ret < 0) {
+      break;
+    }
+  }
+}
+
+static int serve_dequeue(serve_t *server) {
+  int conn = -1;
+  pthread_mutex_lock(&server->lock);
+  while (!server->queue_count && !server->stopping) {
+    pthread_cond_wait(&server->not_empty, &server->lock);
+  }
+  if (server->queue_count) {
+    conn = server->queue[server->queue_head];
+    server->queue_head = (server->queue_head + 1) % SERVE_QUEUE_SIZE;
+    server->queue_count--;
+    pthread_cond_signal(&server->not_full);
+  }
+  pthread_mutex_unlock(&server->lock);
+  return conn;
+}
+
+static void serve_enqueue(serve_t *server, int conn) {
+  pthread_mutex_lock(&server->lock);
+  while (server->queue_count == SERVE_QUEUE_SIZE) {
+    pthread_cond_wait(&server->not_full, &server->lock);
+  }
+  server->queue[(server->queue_head + server->queue_count) % SERVE_QUEUE_SIZE] = conn;
+  server->queue_count++;
+  pthread_mutex_lock(&server->metrics.lock);
+  if (server->queue_count > server->metrics.queue_max) {
+    server->metrics.queue_max = server->queue_count;
+  }
+  pthread_mutex_unlock(&server->metrics.lock);
+  pthread_cond_signal(&server->not_empty);
+  pthread_mutex_unlock(&server->lock);
+}
+
+/*
+ * Pages of worker buffers are first touched by worker, so pinned worker
+ * gets them on its node.
+ */
+static void* serve_worker_run(void *arg) {
+  serve_worker *worker = arg;
+  serve_t *server = worker->server;
+  int conn;
+  if (server->numa) {
+    numa_bind_worker(server->numa, worker - server->workers,
+                     server->workers_count);
+  }
+  while ((conn = serve_dequeue(worker->server)) >= 0) {
+    serve_connection(worker, conn);
+    close(conn);
+  }
+  return NULL;
+}
+
+static int32_t serve_worker_init(serve_worker *worker, serve_t *server,
+                                 bool cache_tables) {
+  worker->server = server;
+  worker->memfd_in = -1;
+  worker->memfd_out = -1;
+  worker->input = buffer_init_memory(server->params.buffer_size);
+  worker->output = buffer_init_memory(server->params.buffer_size);
+  if (!worker->input || !worker->output) {
+    ERROR_GOTO();
+  }
+  worker->memfd_in = memfd_create("huff-in", MFD_CLOEXEC);
+  worker->memfd_out = memfd_create("huff-out", MFD_CLOEXEC);
+  if (worker->memfd_in < 0 || worker->memfd_out < 0) {
+    ERROR_GOTO();
+  }
+  if (cache_tables) {
+    worker->cache = CALLOC(1, sizeof(*worker->cache));
+  }
+  return 0;
+_err:
+  ERROR_MSG();
+  ERROR_RETURN(-1);
+}
+
+static void serve_worker_destroy(serve_worker *worker) {
+  if (worker->input) {
+    buffer_destroy(worker->input);
+  }
+  if (worker->output) {
+    buffer_destroy(worker->output);
+  }
+  if (worker->memfd_in >= 0) {
+    close(worker->memfd_in);
+  }
+  if (worker->memfd_out >= 0) {
+    close(worker->memfd_out);
+  }
+  if (worker->cache) {
+    huff_table_cache_clear(worker->cache);
+    FREE(worker->cache);
+  }
+}
+
+static int serve_listen(const char *socket_path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  int listener = -1;
+
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    eprintf("Socket path is too long\n");
+    ERROR_GOTO();
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0) {
+    ERROR_GOTO();
+  }
+  unlink(socket_path);
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listener, SERVE_QUEUE_SIZE) < 0) {
+    eprintf("Cannot listen on %s\n", socket_path);
+    ERROR_GOTO();
+  }
+  return listener;
+_err:
+  ERROR_MSG();
+  if (listener >= 0) {
+    close(listener);
+  }
+  ERROR_RETURN(-1);
+}
+
+int32_t huffman_serve(const char *socket_path, uint32_t workers_count,
+                      bool cache_tables, const huff_params *params) {
+  struct sigaction action = { .sa_handler = serve_on_signal };
+  sigset_t stop_signals;
+  serve_t server = {
+    .listener = -1,
+    .params = *params,
+    .workers_count = workers_count ? workers_count : SERVE_DEFAULT_WORKERS,
+  };
+  numa_topology topo;
+  uint32_t started = 0;
+  int32_t ret = 0;
+  uint32_t i;
+
+  if (params->numa && numa_topology_init(&topo) == 0) {
+    server.numa = &topo;
+  }
+  server.params.progress_interval = 0;
+  server.params.profile = false;
+  server.params.append = false;
+  server.params.records = false;
+  pthread_mutex_init(&server.lock, NULL);
+  pthread_mutex_init(&server.metrics.lock, NULL);
+  pthread_cond_init(&server.not_empty, NULL);
+  pthread_cond_init(&server.not_full, NULL);
+
+  /* Select kernels once before workers use them. */
+  cpu_path();
+
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+
+  server.listener = serve_listen(socket_path);
+  if (server.listener < 0) {
+    ERROR_GOTO();
+  }
+
+  server.workers = CALLOC(server.workers_count, sizeof(*server.workers));
+  pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+  for (started = 0; started < server.workers_count; started++) {
+    serve_worker *worker = &server.workers[started];
+    if (serve_worker_init(worker, &server, cache_tables) < 0 ||
+        pthread_create(&worker->thread, NULL, serve_worker_run, worker)) {
+      serve_worker_destroy(worker);
+      ret = -1;
+      break;
+    }
+  }
+  pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+
+  if (!ret) {
+    eprintf("Serving on %s with %u workers\n", socket_path, server.workers_count);
+    if (server.numa) {
+      numa_report(server.numa, server.workers_count);
+    }
+  }
+  while (!ret && !serve_stop_signal) {
+    int conn = accept4(server.listener, NULL, NULL, SOCK_CLOEXEC);
+    if (conn < 0) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        ERROR_MSG();
+        ret = -1;
+      }
+      continue;
+    }
+    serve_enqueue(&server, conn);
+  }
+
+  pthread_mutex_lock(&server.lock);
+  server.stopping = true;
+  pthread_cond_broadcast(&server.not_empty);
+  pthread_mutex_unlock(&server.lock);
+  for (i = 0; i < started; i++) {
+    pthread_join(server.workers[i].thread, NULL);
+    serve_worker_destroy(&server.workers[i]);
+  }
+  FREE(server.workers);
+  close(server.listener);
+  unlink(socket_path);
+  return ret;
+_err:
+  ERROR_MSG();
+  FREE(server.workers);
+  ERROR_RETURN(-1);
+}
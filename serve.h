@@ -0,0 +1,168 @@
+/**
+ * @file       serve.h
+ * @author     Alina Zhulanova
+ * @date       26 May 2017
+ * @brief      Function prototypes for compression daemon on unix socket.
+ *
+ * @copyright  Copyright (c) 2017, Alina Zhulanova
+ * @license    This file is released under the GNU Public license
+ * @bug        No known bugs.
+ */
+
+#ifndef SERVE_H_
+#define SERVE_H_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/un.h>
+#include "error_handler.h"
+#include "macros.h"
+#include "buffer.h"
+#include "huff_table.h"
+#include "huffman.h"
+
+
+#define SERVE_DEFAULT_WORKERS 4             /// Workers if not set
+#define SERVE_QUEUE_SIZE 64                 /// Connections waiting for worker
+#define SERVE_LATENCY_BUCKETS 40            /// Log2 buckets of microseconds
+#define SERVE_MESSAGE_SIZE 16               /// Size of request and response
+#define SERVE_METRICS_SIZE 1024             /// Max size of metrics text
+#define SERVE_FLAG_FDS 0x1                  /// Request carries in/out files
+#define SERVE_MAX_FDS 2                     /// Input and output files
+
+/*
+ * Request, 16 bytes little endian:
+ *   op u8, flags u8, reserved u16, block_size u32, size u64
+ * With SERVE_FLAG_FDS input and output files are passed in SCM_RIGHTS of
+ * the same message and size is ignored, else size bytes of input follow.
+ *
+ * Response, 16 bytes little endian:
+ *   status i32, reserved u32, size u64
+ * Size is count of output bytes. They follow the response unless files
+ * were passed, then they are written to output file.
+ */
+typedef enum {
+  SERVE_COMPRESS = 'c',             /**< Encode input */
+  SERVE_DECOMPRESS = 'x',           /**< Decode input */
+  SERVE_METRICS = 'm',              /**< Get metrics as text */
+} serve_op_t;
+
+ /**
+  * @struct serve_request
+  * @brief This struct store one request of client
+  */
+typedef struct serve_request {
+  uint8_t  op;                      /**< Operation, serve_op_t */
+  uint8_t  flags;                   /**< SERVE_FLAG_* */
+  uint32_t block_size;              /**< Size of archive block, 0 is off */
+  uint64_t size;                    /**< Size of inline input */
+} serve_request;
+
+ /**
+  * @struct serve_metrics
+  * @brief This struct store counters of daemon, guarded by lock
+  */
+typedef struct serve_metrics {
+  pthread_mutex_t lock;             /**< Guard of counters */
+  uint64_t requests;                /**< Count of done requests */
+  uint64_t failures;                /**< Count of failed requests */
+  uint64_t bytes_in;                /**< Input bytes of requests */
+  uint64_t bytes_out;               /**< Output bytes of requests */
+  uint64_t table_hits;              /**< Decode tables taken from cache */
+  uint64_t table_misses;            /**< Decode tables built */
+  uint32_t queue_max;               /**< Largest queue depth */
+  uint64_t latency[SERVE_LATENCY_BUCKETS]; /**< Requests by log2 of usec */
+} serve_metrics;
+
+struct serve_t;
+
+ /**
+  * @struct serve_worker
+  * @brief This struct store thread of pool and its reusable memory
+  */
+typedef struct serve_worker {
+  pthread_t thread;                 /**< Worker thread */
+  struct serve_t *server;           /**< Owner */
+  buffer_t *input;                  /**< Input buffer, reused */
+  buffer_t *output;                 /**< Output buffer, reused */
+  int memfd_in;                     /**< File for inline input */
+  int memfd_out;                    /**< File for inline output */
+  huff_table_cache *cache;          /**< Decode tables or NULL */
+  uint64_t input_size;              /**< Input bytes of last request */
+  uint64_t output_size;             /**< Output bytes of last request */
+} serve_worker;
+
+ /**
+  * @struct serve_t
+  * @brief This struct store daemon state
+  */
+typedef struct serve_t {
+  int listener;                     /**< Listening socket */
+  huff_params params;               /**< Options for all requests */
+  uint32_t workers_count;           /**< Size of pool */
+  serve_worker *workers;            /**< Pool */
+  int queue[SERVE_QUEUE_SIZE];      /**< Accepted connections */
+  uint32_t queue_head;              /**< First connection in queue */
+  uint32_t queue_count;             /**< Count of connections in queue */
+  bool stopping;                    /**< Workers must exit */
+  pthread_mutex_t lock;             /**< Guard of queue */
+  pthread_cond_t not_empty;         /**< Signaled on enqueue and stop */
+  pthread_cond_t not_full;          /**< Signaled on dequeue */
+  serve_metrics metrics;            /**< Counters */
+  const numa_topology *numa;        /**< Pin workers by node or NULL */
+} serve_t;
+
+/**
+ * Macros to parse request from little endian message.
+ */
+#define SERVE_REQUEST_PARSE(request, message)                                  \
+      ({                                                                       \
+        (request).op = (message)[0];                                           \
+        (request).flags = (message)[1];                                        \
+        memcpy(&(request).block_size, &(message)[4],                           \
+               sizeof((request).block_size));                                  \
+        memcpy(&(request).size, &(message)[8], sizeof((request).size));        \
+        (request).block_size = le32toh((request).block_size);                  \
+        (request).size = le64toh((request).size);                              \
+      })
+
+/**
+ * Macros to build little endian response message.
+ */
+#define SERVE_RESPONSE_BUILD(message, status, size)                            \
+      ({                                                                       \
+        int32_t tmp_status = htole32(status);                                  \
+        uint64_t tmp_size = htole64(size);                                     \
+        memset(message, 0, SERVE_MESSAGE_SIZE);                                \
+        memcpy(&(message)[0], &tmp_status, sizeof(tmp_status));                \
+        memcpy(&(message)[8], &tmp_size, sizeof(tmp_size));                    \
+      })
+
+/**
+ * @brief Run compression daemon
+ * @details Listen on unix socket at socket_path and serve requests with
+ * fixed pool of workers. Each worker keeps its buffers between requests.
+ * Runs until SIGINT or SIGTERM, then removes socket.
+ *
+ * @param socket_path Path of socket
+ * @param workers_count Count of workers, 0 for default
+ * @param cache_tables Keep decode tables per worker
+ * @param params Options for all requests
+ * @return 0 on success and -1 if faild
+ */
+int32_t huffman_serve(const char *socket_path, uint32_t workers_count,
+                      bool cache_tables, const huff_params *params);
+
+#endif /* SERVE_H_ */